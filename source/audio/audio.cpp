@@ -141,27 +141,38 @@ void audio::update(::client& client) {
         ));
     }
 
-    for (int i = 0; i < client.users.position.size(); i++) {
+    for (int slot = 0; slot < client.users.position.size(); slot++) {
         scope_trace trace;
 
-        if (i >= sources_count)
-            break;
+        auto &voice = client.users.voice[slot];
+        if (voice.size == 0)
+            continue;
 
-        if (client.users.encoded_audio_out_size[i] == 0)
+        // users that didn't get a source aren't heard
+        auto i = client.users.source[slot];
+        if (i == -1) {
+            voice.clear();
             continue;
+        }
 
-        // TODO: number of samples in packet could differ from buffer_size
-        opus_check(opus_decode(
-            decoders[i].get(), client.users.encoded_audio_out[i].data(), 
-            client.users.encoded_audio_out_size[i],
-            capture_data, std::size(capture_data), 0
-        ));
-        client.users.encoded_audio_out_size[i] = 0;
+        if (client.source_reset[i]) {
+            opus_check(opus_decoder_ctl(decoders[i].get(), OPUS_RESET_STATE));
+            client.source_reset[i] = false;
+        }
+
+        // a packet per processed buffer, the others wait for the next frame
         ALint processed = 0;
         alGetSourcei(sources.get()[i], AL_BUFFERS_PROCESSED, &processed);
         openal_check();
-        // drop samples if not ready to play them
-        if (processed > 0) {
+        for (; processed > 0 && voice.size > 0; processed--) {
+            auto packet = voice.front();
+            // TODO: number of samples in packet could differ from buffer_size
+            opus_check(opus_decode(
+                decoders[i].get(), packet.data(), packet.size(),
+                capture_data, std::size(capture_data), 0
+            ));
+            voice.pop();
+
             ALuint unqueued_buffer = 0;
             alSourceUnqueueBuffers(sources.get()[i], 1, &unqueued_buffer);
             openal_check();
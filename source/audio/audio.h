@@ -11,7 +11,7 @@
 
 constexpr std::size_t buffer_count = 4;
 constexpr std::size_t buffer_size = 2880; // largest Opus frame size
-constexpr std::size_t sources_count = 32;
+constexpr std::size_t sources_count = audio_source_count;
 
 struct audio {
     audio();
@@ -19,6 +19,7 @@ struct audio {
     void update(::client &client);
 
     unique_opus_encoder encoder;
+    // one per source, reset when the source is handed to another user
     unique_opus_decoder decoders[sources_count];
 
     unique_openal_capture_device capture_device;
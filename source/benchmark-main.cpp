@@ -0,0 +1,940 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string_view>
+#include <cmath>
+#include <atomic>
+#include <random>
+#include <string>
+#include <span>
+#include <algorithm>
+
+#ifdef __unix__
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include "server/server.h"
+#include "server/interest.h"
+#include "network/network_message.h"
+#include "utility/serialization.h"
+#include "utility/fixed_point.h"
+#include "utility/file.h"
+#include "utility/math.h"
+#include "state/model.h"
+
+// Benchmarks that don't need a window or a GPU. Pass the name of a benchmark to
+// only run that one.
+
+using namespace std::chrono;
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+
+// 0 uses each benchmark's default
+unsigned session_count = 0;
+
+asio::awaitable<void> discard_ticks(
+    std::shared_ptr<beast::websocket::stream<asio::ip::tcp::socket>> stream,
+    std::shared_ptr<std::atomic_uint32_t> last_tick
+) {
+    boost::system::error_code error;
+    auto completion_token = asio::redirect_error(asio::use_awaitable, error);
+    beast::flat_buffer buffer;
+    while (!error) {
+        co_await stream->async_read(buffer, completion_token);
+        // the tick number is at the start of the message, in big-endian
+        auto bytes = static_cast<const std::uint8_t*>(buffer.cdata().data());
+        if (buffer.size() >= 4)
+            *last_tick =
+                bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+        buffer.consume(buffer.size());
+    }
+}
+
+// Connects to the server and sends a pose every tick like a client would
+asio::awaitable<void> bot(unsigned short port, unsigned index) {
+    boost::system::error_code error;
+    auto completion_token = asio::redirect_error(asio::use_awaitable, error);
+    auto executor = co_await asio::this_coro::executor;
+
+    auto stream = std::make_shared<
+        beast::websocket::stream<asio::ip::tcp::socket>
+    >(executor);
+    co_await stream->next_layer().async_connect(
+        {asio::ip::make_address("127.0.0.1"), port}, completion_token
+    );
+    if (error)
+        co_return;
+    co_await stream->async_handshake("localhost", "/", completion_token);
+    if (error)
+        co_return;
+    stream->binary(true);
+
+    // the answer to the handshake isn't needed, ticks are discarded anyway
+    auto request = handshake_request();
+    std::vector<std::uint8_t> buffer(capacity(request));
+    co_await stream->async_write(
+        asio::buffer(buffer.data(), write(request, buffer)), completion_token
+    );
+    beast::flat_buffer response;
+    if (!error)
+        co_await stream->async_read(response, completion_token);
+    if (error)
+        co_return;
+
+    auto last_tick = std::make_shared<std::atomic_uint32_t>(0);
+    co_spawn(executor, discard_ticks(stream, last_tick), asio::detached);
+
+    message m;
+    m.reset(1, message_audio_capacity);
+    m.users.size = 1;
+    buffer.resize(capacity(m));
+
+    asio::steady_timer timer(executor, steady_clock::now());
+    for (unsigned t = 0; !error; t++) {
+        float angle = (index + t) * 0.01f;
+        m.users.position[0] = std::cos(angle) * index * 0.1f;
+        m.users.position[1] = std::sin(angle) * index * 0.1f;
+        m.users.orientation[3] = 1;
+        // acknowledge the last tick, so the server can send deltas
+        m.tick = *last_tick;
+        auto size = write(m, buffer);
+        co_await stream->async_write(
+            asio::buffer(buffer.data(), size), completion_token
+        );
+
+        timer.expires_at(timer.expiry() + tick_time);
+        co_await timer.async_wait(completion_token);
+    }
+}
+
+void run_threads(
+    asio::io_context &context, unsigned count, std::vector<std::thread> &threads
+) {
+    for (auto i = 0u; i < count; i++)
+        threads.emplace_back([&context](){ context.run(); });
+}
+
+void benchmark_server_tick() {
+    // Measures the time from the start of a tick until the last session
+    // received it, with session_count clients connected over localhost.
+    auto session_count = ::session_count ? ::session_count : 200;
+    printf("server-tick: %u sessions\n", session_count);
+    printf(
+        "threads, ticks, dropped frames, mean tick duration (us), "
+        "mean frame size (bytes)\n"
+    );
+
+    unsigned hardware_threads =
+        std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned thread_count = 1;; thread_count *= 2) {
+        thread_count = std::min(thread_count, hardware_threads);
+
+        asio::io_context server_context(thread_count);
+        server_t s(server_context, 0);
+        start(s);
+        auto port = s.acceptor.local_endpoint().port();
+
+        asio::io_context client_context;
+        for (auto i = 0u; i < session_count; i++)
+            co_spawn(
+                asio::make_strand(client_context), bot(port, i),
+                asio::detached
+            );
+
+        std::vector<std::thread> threads;
+        run_threads(server_context, thread_count, threads);
+        run_threads(client_context, hardware_threads, threads);
+
+        // give all clients time to connect
+        std::this_thread::sleep_for(seconds(2));
+        s.tick_count = 0;
+        s.tick_duration_total = 0;
+        auto sum = [&s](std::atomic_uint64_t session::*counter) {
+            std::scoped_lock lock(s.sessions_mutex);
+            std::uint64_t count = 0;
+            for (auto &session : s.sessions)
+                count += *session.*counter;
+            return count;
+        };
+        auto dropped_frame_count_start = sum(&session::dropped_frame_count);
+        auto sent_frame_count_start = sum(&session::sent_frame_count);
+        auto sent_byte_count_start = sum(&session::sent_byte_count);
+        std::this_thread::sleep_for(seconds(5));
+
+        std::uint64_t
+            tick_count = s.tick_count,
+            tick_duration_total = s.tick_duration_total,
+            sent_frame_count =
+                sum(&session::sent_frame_count) - sent_frame_count_start,
+            sent_byte_count =
+                sum(&session::sent_byte_count) - sent_byte_count_start;
+        printf(
+            "%u, %llu, %llu, %llu, %llu\n", thread_count,
+            (long long unsigned)tick_count,
+            (long long unsigned)(
+                sum(&session::dropped_frame_count) - dropped_frame_count_start
+            ),
+            (long long unsigned)(tick_duration_total / std::max<std::uint64_t>(
+                1, tick_count
+            )),
+            (long long unsigned)(sent_byte_count / std::max<std::uint64_t>(
+                1, sent_frame_count
+            ))
+        );
+        fflush(stdout);
+
+        client_context.stop();
+        server_context.stop();
+        for (auto &thread : threads)
+            thread.join();
+
+        if (thread_count == hardware_threads)
+            break;
+    }
+}
+
+// CPU time that a thread used so far, 0 where that isn't available
+nanoseconds thread_cpu_time(std::thread &thread) {
+#ifdef __unix__
+    clockid_t clock;
+    timespec time;
+    if (
+        pthread_getcpuclockid(thread.native_handle(), &clock) == 0 &&
+        clock_gettime(clock, &time) == 0
+    )
+        return seconds(time.tv_sec) + nanoseconds(time.tv_nsec);
+#endif
+    return nanoseconds(0);
+}
+
+void benchmark_broadcast() {
+    // CPU time of the server per tick, with Beast framing every write and with
+    // frames that are built once per tick. The server runs on a single thread,
+    // so its CPU time can be told apart from the clients'.
+    auto session_count = ::session_count ? ::session_count : 500;
+    printf("broadcast: %u sessions\n", session_count);
+    printf("writes, ticks, server cpu time per tick (us)\n");
+
+    unsigned hardware_threads =
+        std::max(1u, std::thread::hardware_concurrency());
+    auto previous_preframed_writes = preframed_writes;
+
+    for (bool preframed : {false, true}) {
+        preframed_writes = preframed;
+
+        asio::io_context server_context(1);
+        server_t s(server_context, 0);
+        start(s);
+        auto port = s.acceptor.local_endpoint().port();
+
+        asio::io_context client_context;
+        for (auto i = 0u; i < session_count; i++)
+            co_spawn(
+                asio::make_strand(client_context), bot(port, i),
+                asio::detached
+            );
+
+        std::vector<std::thread> threads;
+        run_threads(server_context, 1, threads);
+        run_threads(client_context, hardware_threads, threads);
+
+        // give all clients time to connect
+        std::this_thread::sleep_for(seconds(2));
+        s.tick_count = 0;
+        auto cpu_time_start = thread_cpu_time(threads[0]);
+        std::this_thread::sleep_for(seconds(5));
+        auto cpu_time = thread_cpu_time(threads[0]) - cpu_time_start;
+        std::uint64_t tick_count = s.tick_count;
+
+        printf(
+            "%s, %llu, %llu\n", preframed ? "preframed" : "beast",
+            (long long unsigned)tick_count,
+            (long long unsigned)(
+                duration_cast<microseconds>(cpu_time).count() /
+                std::max<std::uint64_t>(1, tick_count)
+            )
+        );
+        fflush(stdout);
+
+        client_context.stop();
+        server_context.stop();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    preframed_writes = previous_preframed_writes;
+}
+
+// users spread randomly over a 200 m square
+void random_room(message &room, unsigned user_count) {
+    room.reset(user_count, message_audio_capacity);
+    room.users.size = user_count;
+    std::mt19937 random(user_count);
+    std::uniform_real_distribution<float> coordinate(-100, 100);
+    for (auto user = 0u; user < user_count; user++) {
+        room.users.position[user * 3 + 0] = coordinate(random);
+        room.users.position[user * 3 + 2] = coordinate(random);
+        room.users.id[user] = user;
+        room.users.orientation[user * 4 + 3] = 1;
+    }
+}
+
+void benchmark_interest() {
+    // Assembles and encodes a tick for every recipient without any sockets,
+    // with users spread randomly over a 200 m square.
+    auto radius = interest_radius > 0 ? interest_radius : 10;
+    printf("interest: radius %g m, %u far users\n", radius, far_user_capacity);
+    printf(
+        "users, bytes per client per tick without interest, "
+        "bytes per client per tick, mean users sent, "
+        "mean tick duration (us)\n"
+    );
+
+    for (unsigned user_count : {100u, 500u, 1000u}) {
+        message room;
+        random_room(room, user_count);
+
+        message m;
+        m.reset(message_user_capacity, message_audio_capacity);
+        std::vector<std::uint8_t> buffer(capacity(m));
+
+        // without interest management everyone gets the first users
+        for (auto user = 0u; user < m.user_capacity; user++)
+            m.append(room, user);
+        auto shared_size = write(m, buffer);
+
+        auto previous_radius = interest_radius;
+        interest_radius = radius;
+        spatial_hash interest;
+        const unsigned tick_count = 20;
+        std::uint64_t byte_count = 0, user_total = 0;
+        auto start = steady_clock::now();
+        for (auto tick = 1u; tick <= tick_count; tick++) {
+            interest.build(room, radius);
+            for (auto recipient = 0u; recipient < user_count; recipient++) {
+                interest.select(room, recipient, tick, m);
+                m.tick = tick;
+                byte_count += write(m, buffer);
+                user_total += m.users.size;
+            }
+        }
+        auto duration = duration_cast<microseconds>(
+            steady_clock::now() - start
+        ).count();
+        interest_radius = previous_radius;
+
+        printf(
+            "%u, %zu, %llu, %.1f, %llu\n", user_count, shared_size,
+            (long long unsigned)(byte_count / (tick_count * user_count)),
+            double(user_total) / (tick_count * user_count),
+            (long long unsigned)(duration / tick_count)
+        );
+        fflush(stdout);
+    }
+}
+
+void benchmark_priority() {
+    // Like interest, but picks users by priority within a byte budget. Every
+    // fourth user is speaking with 40 bytes of audio and every third is
+    // walking. Measures how often users near and far from a recipient are
+    // updated.
+    auto budget = message_byte_budget > 0 ? message_byte_budget : 200;
+    printf("priority: budget %u bytes\n", budget);
+    printf(
+        "users, bytes per client per tick, "
+        "update rate within 20 m, update rate beyond 50 m, "
+        "mean tick duration (us)\n"
+    );
+
+    for (unsigned user_count : {100u, 500u, 1000u}) {
+        message room;
+        random_room(room, user_count);
+        std::vector<room_user> users(user_count);
+        for (auto user = 0u; user < user_count; user++) {
+            users[user] = {std::uint16_t(user), user % 3 == 0 ? 1.4f : 0.f};
+            if (user % 4 == 0)
+                room.users.voice[user].first = 40;
+        }
+
+        message m;
+        m.reset(message_user_capacity, message_audio_capacity);
+        std::vector<std::uint8_t> buffer(capacity(m));
+        std::vector<priority_accumulator> priorities(user_count);
+
+        const unsigned tick_count = 20;
+        std::uint64_t byte_count = 0, duration = 0;
+        std::uint64_t
+            near_count = 0, near_sent = 0, far_count = 0, far_sent = 0;
+        for (auto tick = 1u; tick <= tick_count; tick++) {
+            for (auto recipient = 0u; recipient < user_count; recipient++) {
+                auto &accumulator = priorities[recipient];
+                auto start = steady_clock::now();
+                accumulator.select(room, users, recipient, budget, false, m);
+                m.tick = tick;
+                byte_count += write(m, buffer);
+                duration += duration_cast<microseconds>(
+                    steady_clock::now() - start
+                ).count();
+
+                // priority starts over at zero for the users that were sent
+                auto center = user_position(room, recipient);
+                for (auto user = 0u; user < user_count; user++) {
+                    bool sent = accumulator.priority[user] == 0;
+                    auto distance =
+                        glm::distance(user_position(room, user), center);
+                    if (distance < 20) {
+                        near_count++;
+                        near_sent += sent;
+                    } else if (distance > 50) {
+                        far_count++;
+                        far_sent += sent;
+                    }
+                }
+            }
+        }
+
+        printf(
+            "%u, %llu, %.3f, %.3f, %llu\n", user_count,
+            (long long unsigned)(byte_count / (tick_count * user_count)),
+            double(near_sent) / std::max<std::uint64_t>(1, near_count),
+            double(far_sent) / std::max<std::uint64_t>(1, far_count),
+            (long long unsigned)(duration / tick_count)
+        );
+        fflush(stdout);
+    }
+}
+
+// set by benchmarks that check their results
+bool failed = false;
+
+void benchmark_fixed_point() {
+    // Converts 4000 values to fixed point and back, in batches and one value
+    // at a time through apply.
+    const unsigned value_count = 1000 * 4, repetitions = 2000;
+    const unsigned mantissa_bits = 15;
+    std::vector<float> values(value_count), decoded(value_count);
+    std::mt19937 random(0);
+    // slightly out of range, so that values get clamped
+    std::uniform_real_distribution<float> value(-1.1f, 1.1f);
+    for (auto &v : values)
+        v = value(random);
+    // and one that isn't a number, which every path turns into 0
+    values[value_count / 2] = std::numeric_limits<float>::quiet_NaN();
+    std::vector<std::uint8_t>
+        scalar_buffer(value_count * 2), batch_buffer(value_count * 2);
+
+    auto time = [](auto f) {
+        auto start = steady_clock::now();
+        for (auto i = 0u; i < repetitions; i++)
+            f();
+        return duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+            double(repetitions * value_count);
+    };
+
+    auto scalar_write = time([&]() {
+        std::span<std::uint8_t> b = scalar_buffer;
+        for (auto v : values) {
+            auto integral = to_fixed_point<std::int16_t, mantissa_bits>(v);
+            apply(integral, write_tag_t{b});
+        }
+    });
+    auto scalar_read = time([&]() {
+        std::span<std::uint8_t> b = scalar_buffer;
+        for (auto &v : decoded) {
+            std::int16_t integral;
+            apply(integral, read_tag_t{b});
+            v = from_fixed_point<std::int16_t, mantissa_bits, float>(integral);
+        }
+    });
+    auto scalar_decoded = decoded;
+
+    auto batch_write = time([&]() {
+        write_int16_fixed_point(
+            values.data(), value_count, 1 << mantissa_bits, batch_buffer.data()
+        );
+    });
+    auto batch_read = time([&]() {
+        read_int16_fixed_point(
+            batch_buffer.data(), value_count, 1 << mantissa_bits,
+            decoded.data()
+        );
+    });
+
+    printf(
+        "fixed-point: %u values, %s kernel\n", value_count, fixed_point_kernel
+    );
+    printf("path, write (ns per value), read (ns per value)\n");
+    printf("scalar, %.2f, %.2f\n", scalar_write, scalar_read);
+    printf("batch, %.2f, %.2f\n", batch_write, batch_read);
+    bool identical = scalar_buffer == batch_buffer && scalar_decoded == decoded;
+    failed |= !identical;
+    printf("results are %s\n", identical ? "identical" : "different");
+    fflush(stdout);
+}
+
+void benchmark_compression() {
+    // Compresses the poses of 1000 users and checks the errors against their
+    // bounds. Positions are truncated, so they are off by less than a step.
+    // The smaller components of orientations are off by half a step at most.
+    // The largest one, which is at least 1/2, is restored from them, so it is
+    // off by at most 3 half steps * sqrt(2) / (1/2).
+    const unsigned user_count = 1000, repetitions = 1000;
+    std::mt19937 random(0);
+    std::normal_distribution<float> normal;
+
+    message m;
+    m.reset(user_count, message_audio_capacity);
+    m.users.size = user_count;
+    m.bounds.origin[0] = 100;
+    m.bounds.origin[2] = -50;
+    float range = float(1 << (15 - m.bounds.mantissa_bits));
+    std::uniform_real_distribution<float> offset(-range, range);
+    for (auto i = 0u; i < user_count * 3; i++)
+        m.users.position[i] = m.bounds.origin[i % 3] + offset(random);
+    // a few edge cases, then random rotations
+    const float edge_cases[][4] {
+        {0, 0, 0, 1}, {0, 0, 0, -1}, {0.5f, 0.5f, 0.5f, 0.5f},
+        {0.5f, -0.5f, 0.5f, -0.5f}, {0.70710678f, 0, 0, 0.70710678f},
+        {0, 0.70710678f, -0.70710678f, 0}, {1, 0, 0, 0},
+    };
+    for (auto user = 0u; user < user_count; user++) {
+        auto orientation = m.users.orientation.begin() + user * 4;
+        if (user < std::size(edge_cases)) {
+            std::copy_n(edge_cases[user], 4, orientation);
+            continue;
+        }
+        float length = 0;
+        for (auto i = 0u; i < 4; i++) {
+            orientation[i] = normal(random);
+            length += orientation[i] * orientation[i];
+        }
+        for (auto i = 0u; i < 4; i++)
+            orientation[i] /= std::sqrt(length);
+    }
+
+    auto time = [](auto f) {
+        auto start = steady_clock::now();
+        for (auto i = 0u; i < repetitions; i++)
+            f();
+        return duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+            double(repetitions * user_count);
+    };
+
+    std::vector<std::uint32_t> compressed(user_count);
+    std::vector<float> decompressed(user_count * 4);
+    auto compress = time([&]() {
+        for (auto user = 0u; user < user_count; user++)
+            compressed[user] = compress_orientation(
+                m.users.orientation.values.get() + user * 4
+            );
+    });
+    auto decompress = time([&]() {
+        for (auto user = 0u; user < user_count; user++)
+            decompress_orientation(
+                compressed[user], decompressed.data() + user * 4
+            );
+    });
+
+    std::vector<std::uint8_t> buffer(capacity(m));
+    std::size_t size = 0;
+    auto write_time = time([&]() { size = write(m, buffer); });
+    message decoded;
+    decoded.reset(user_count, message_audio_capacity);
+    decoded.bounds = m.bounds;
+    auto read_time = time([&]() { read(decoded, {buffer.data(), size}); });
+
+    float position_error = 0, orientation_error = 0;
+    for (auto i = 0u; i < user_count * 3; i++)
+        position_error = std::max(
+            position_error,
+            std::abs(decoded.users.position[i] - m.users.position[i])
+        );
+    for (auto user = 0u; user < user_count; user++) {
+        // q and -q are the same rotation
+        float same = 0, opposite = 0;
+        for (auto i = user * 4; i < user * 4 + 4; i++) {
+            auto a = m.users.orientation[i], b = decoded.users.orientation[i];
+            same = std::max(same, std::abs(b - a));
+            opposite = std::max(opposite, std::abs(b + a));
+        }
+        orientation_error =
+            std::max(orientation_error, std::min(same, opposite));
+    }
+    float position_bound = 1 / float(1 << m.bounds.mantissa_bits);
+    float half_step =
+        0.5f / ((1 << (orientation_component_bits - 1)) - 1) / std::sqrt(2.f);
+    // and some room for rounding
+    float orientation_bound = 6 * std::sqrt(2.f) * half_step + 1e-6f;
+    bool within_bounds =
+        position_error < position_bound &&
+        orientation_error <= orientation_bound;
+    failed |= !within_bounds;
+
+    printf(
+        "compression: %u users, %zu bytes per user without voice\n",
+        user_count, message_user_size
+    );
+    printf("operation, ns per user\n");
+    printf("compress orientation, %.2f\n", compress);
+    printf("decompress orientation, %.2f\n", decompress);
+    printf("write message, %.2f\n", write_time);
+    printf("read message, %.2f\n", read_time);
+    printf("value, largest error, bound\n");
+    printf("position, %g, %g\n", position_error, position_bound);
+    printf(
+        "orientation component, %g, %g\n", orientation_error,
+        orientation_bound
+    );
+    printf(
+        "errors are %s\n", within_bounds ? "within bounds" : "out of bounds"
+    );
+    fflush(stdout);
+}
+
+void benchmark_model_loading() {
+    // Converts the models that the client loads at startup, with 1, 2, 4, ...
+    // threads. The files are read beforehand, so only conversion and image
+    // decoding are measured. Run from the directory with test_files in it.
+    const char *names[] {
+        "test_files/AvatarSample_B.vrm",
+        "test_files/white_modern_living_room.glb",
+    };
+    std::vector<std::vector<std::uint8_t>> files;
+    try {
+        for (auto name : names)
+            files.push_back(read_file(name));
+    } catch (const std::exception &) {
+        printf("model-loading: test_files not found, skipped\n");
+        return;
+    }
+    const unsigned repetitions = 3;
+
+    printf("model-loading: %zu models\n", files.size());
+    printf("threads, fastest wall time (ms), speedup\n");
+
+    unsigned hardware_threads =
+        std::max(1u, std::thread::hardware_concurrency());
+    double single_thread = 0;
+    for (unsigned thread_count = 1;; thread_count *= 2) {
+        thread_count = std::min(thread_count, hardware_threads);
+        model_thread_count = thread_count;
+
+        double fastest = 0;
+        for (auto i = 0u; i < repetitions; i++) {
+            auto start = steady_clock::now();
+            for (auto &file : files)
+                model loaded({file.data(), file.data() + file.size()});
+            double duration =
+                duration_cast<microseconds>(steady_clock::now() - start)
+                .count() / 1000.;
+            fastest = i == 0 ? duration : std::min(fastest, duration);
+        }
+        if (thread_count == 1)
+            single_thread = fastest;
+        printf(
+            "%u, %.1f, %.2f\n", thread_count, fastest, single_thread / fastest
+        );
+        fflush(stdout);
+
+        if (thread_count == hardware_threads)
+            break;
+    }
+    model_thread_count = 0;
+
+    // Loads them as at startup, first without cache files, which are written
+    // then, and again with them
+    printf("model-loading: cold and warm start\n");
+    printf("start, fastest wall time (ms)\n");
+    for (bool warm : {false, true}) {
+        double fastest = 0;
+        for (auto i = 0u; i < repetitions; i++) {
+            if (!warm)
+                for (auto name : names)
+                    std::remove(
+                        (std::string(name) + model_cache_extension).c_str()
+                    );
+            auto start = steady_clock::now();
+            for (auto name : names)
+                load_model(name);
+            double duration =
+                duration_cast<microseconds>(steady_clock::now() - start)
+                .count() / 1000.;
+            fastest = i == 0 ? duration : std::min(fastest, duration);
+        }
+        printf("%s, %.1f\n", warm ? "warm" : "cold", fastest);
+        fflush(stdout);
+    }
+}
+
+// A glTF binary with mesh_count meshes that are the same quad, and the given
+// JSON array of nodes
+std::vector<std::uint8_t> quad_scene(
+    const std::string &nodes, unsigned mesh_count
+) {
+    const float positions[] {0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0};
+    const float normals[] {0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1};
+    const float texture_coordinates[] {0, 0, 1, 0, 1, 1, 0, 1};
+    const std::uint32_t indices[] {0, 1, 2, 0, 2, 3};
+    std::vector<std::uint8_t> binary;
+    auto append = [&binary](const auto &array) {
+        auto bytes = reinterpret_cast<const std::uint8_t*>(array);
+        binary.insert(binary.end(), bytes, bytes + sizeof(array));
+    };
+    append(positions);
+    append(normals);
+    append(texture_coordinates);
+    append(indices);
+
+    std::string json = R"({"asset":{"version":"2.0"},)"
+        R"("bufferViews":[)"
+        R"({"buffer":0,"byteOffset":0,"byteLength":48},)"
+        R"({"buffer":0,"byteOffset":48,"byteLength":48},)"
+        R"({"buffer":0,"byteOffset":96,"byteLength":32},)"
+        R"({"buffer":0,"byteOffset":128,"byteLength":24}],)"
+        R"("accessors":[)"
+        R"({"bufferView":0,"componentType":5126,"count":4,"type":"VEC3"},)"
+        R"({"bufferView":1,"componentType":5126,"count":4,"type":"VEC3"},)"
+        R"({"bufferView":2,"componentType":5126,"count":4,"type":"VEC2"},)"
+        R"({"bufferView":3,"componentType":5125,"count":6,"type":"SCALAR"}],)"
+        R"("materials":[{"pbrMetallicRoughness":)"
+        R"({"baseColorTexture":{"index":0}}}],)"
+        R"("meshes":[)";
+    for (auto i = 0u; i < mesh_count; i++) {
+        json += i == 0 ? "" : ",";
+        json += R"({"primitives":[{"attributes":)"
+            R"({"POSITION":0,"NORMAL":1,"TEXCOORD_0":2},)"
+            R"("indices":3,"material":0}]})";
+    }
+    json += R"(],"nodes":)" + nodes + "}";
+    json.resize(round_up(json.size(), 4), ' ');
+
+    std::vector<std::uint8_t> file;
+    auto append_integer = [&file](std::uint32_t value) {
+        for (auto i = 0u; i < 4; i++)
+            file.push_back(value >> (i * 8));
+    };
+    append_integer(0x46546C67); // glTF
+    append_integer(2);
+    append_integer(12 + 8 + json.size() + 8 + binary.size());
+    append_integer(json.size());
+    append_integer(0x4E4F534A); // JSON
+    file.insert(file.end(), json.begin(), json.end());
+    append_integer(binary.size());
+    append_integer(0x004E4942); // BIN
+    file.insert(file.end(), binary.begin(), binary.end());
+    return file;
+}
+
+// one quad, used by copy_count nodes along x
+std::vector<std::uint8_t> instanced_scene(unsigned copy_count) {
+    std::string nodes = "[";
+    for (auto i = 0u; i < copy_count; i++) {
+        nodes += i == 0 ? "" : ",";
+        nodes += R"({"mesh":0,"matrix":[1,0,0,0,0,1,0,0,0,0,1,0,)";
+        nodes += std::to_string(i) + ",0,0,1]}";
+    }
+    return quad_scene(nodes + "]", 1);
+}
+
+void benchmark_instancing() {
+    // Loads a scene that uses the same quad many times. Its vertices and
+    // indices have to be stored once, with a world matrix for each node.
+    printf("instancing: one quad used by many nodes\n");
+    printf(
+        "nodes, vertices, indices, instances, vertex and index bytes, "
+        "bytes with a copy per node\n"
+    );
+    bool correct = true;
+    for (unsigned copy_count : {1u, 10u, 1000u}) {
+        auto file = instanced_scene(copy_count);
+        model scene({file.data(), file.data() + file.size()});
+
+        auto bytes =
+            scene.positions.size() + scene.normals.size() +
+            scene.texture_coordinates.size() + scene.indices.size();
+        auto vertex_count = scene.positions.size() / 8;
+        auto index_count = scene.indices.size() / 2;
+        bool instances_correct =
+            scene.primitives.size() == 1 &&
+            scene.primitives[0].instance_count == copy_count &&
+            scene.instances.size() == copy_count;
+        for (auto i = 0u; instances_correct && i < copy_count; i++)
+            instances_correct = scene.instances[i][3][0] == float(i);
+        correct &=
+            vertex_count == 4 && index_count == 6 && instances_correct &&
+            scene.normals.size() / 4 == vertex_count &&
+            scene.texture_coordinates.size() / 4 == vertex_count;
+
+        printf(
+            "%u, %zu, %zu, %zu, %zu, %zu\n", copy_count, vertex_count,
+            index_count, scene.instances.size(), bytes, bytes * copy_count
+        );
+    }
+    failed |= !correct;
+    printf(
+        "stored data %s the unique mesh data\n",
+        correct ? "matches" : "doesn't match"
+    );
+    fflush(stdout);
+}
+
+void check_model_conversion() {
+    // Two meshes used by three nodes, two of them below a parent that scales
+    // them. Each primitive has to be stored once with the world matrices of
+    // its nodes, and a cache file has to hold the same model.
+    printf("model-conversion: several nodes and a cache file\n");
+    std::string nodes =
+        R"([{"children":[1,2],"matrix":[2,0,0,0,0,2,0,0,0,0,2,0,0,0,0,1]},)"
+        R"({"mesh":0,"matrix":[1,0,0,0,0,1,0,0,0,0,1,0,1,0,0,1]},)"
+        R"({"mesh":1,"matrix":[1,0,0,0,0,1,0,0,0,0,1,0,0,3,0,1]},)"
+        R"({"mesh":0,"matrix":[0,1,0,0,-1,0,0,0,0,0,1,0,0,0,5.5,1]}])";
+    auto file = quad_scene(nodes, 2);
+    model converted({file.data(), file.data() + file.size()});
+
+    glm::mat4 scale(2), first(1), second(1), third(1);
+    scale[3][3] = 1;
+    first[3] = {1, 0, 0, 1};
+    second[3] = {0, 3, 0, 1};
+    third[0] = {0, 1, 0, 0};
+    third[1] = {-1, 0, 0, 0};
+    third[3] = {0, 0, 5.5, 1};
+    // in the order of the nodes, for each primitive
+    std::vector<std::vector<glm::mat4>> expected {
+        {scale * first, third}, {scale * second}
+    };
+
+    bool instances_correct =
+        converted.primitives.size() == expected.size() &&
+        converted.instances.size() == 3;
+    for (auto p = 0u; instances_correct && p < expected.size(); p++) {
+        auto &primitive = converted.primitives[p];
+        instances_correct =
+            primitive.instance_count == expected[p].size() &&
+            std::equal(
+                expected[p].begin(), expected[p].end(),
+                converted.instances.begin() + primitive.instance_begin
+            );
+    }
+    // a quad for each mesh, not for each node
+    bool vertices_correct =
+        converted.positions.size() / 8 == 2 * 4 &&
+        converted.indices.size() / 2 == 2 * 6;
+    printf(
+        "instances and world matrices %s, vertices %s\n",
+        instances_correct ? "match" : "don't match",
+        vertices_correct ? "match" : "don't match"
+    );
+
+    // converts and writes the cache file, then only reads that
+    const char *name = "model-conversion.glb";
+    auto cache_name = std::string(name) + model_cache_extension;
+    std::remove(cache_name.c_str());
+    auto scene_file = fopen(name, "wb");
+    bool cache_correct =
+        scene_file &&
+        fwrite(file.data(), 1, file.size(), scene_file) == file.size();
+    if (scene_file)
+        cache_correct &= fclose(scene_file) == 0;
+    if (cache_correct) {
+        load_model(name);
+        auto cached = load_model(name);
+        auto same_primitive = [](
+            const model::mesh_primitive &a, const model::mesh_primitive &b
+        ) {
+            return
+                a.vertex_begin == b.vertex_begin &&
+                a.face_begin == b.face_begin && a.face_size == b.face_size &&
+                a.image_index == b.image_index &&
+                a.instance_begin == b.instance_begin &&
+                a.instance_count == b.instance_count &&
+                a.position_offset == b.position_offset &&
+                a.position_scale == b.position_scale &&
+                a.texture_coordinate_offset == b.texture_coordinate_offset &&
+                a.texture_coordinate_scale == b.texture_coordinate_scale;
+        };
+        auto same_bytes = [](std::span<uint8_t> a, std::span<uint8_t> b) {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end());
+        };
+        // read from the cache, not converted again
+        cache_correct =
+            cached.storage.empty() && cached.cache.size > 0 &&
+            std::equal(
+                cached.primitives.begin(), cached.primitives.end(),
+                converted.primitives.begin(), converted.primitives.end(),
+                same_primitive
+            ) &&
+            cached.instances == converted.instances &&
+            cached.images.size() == converted.images.size();
+        for (auto i = 0u; i < converted.arrays().size(); i++)
+            cache_correct &=
+                same_bytes(*cached.arrays()[i], *converted.arrays()[i]);
+    }
+    std::remove(name);
+    std::remove(cache_name.c_str());
+    printf(
+        "the cached model %s the converted one\n",
+        cache_correct ? "matches" : "doesn't match"
+    );
+    failed |= !instances_correct || !vertices_correct || !cache_correct;
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    std::string_view name;
+    for (auto argument = argv + 1; *argument != nullptr; argument++) {
+        if (strcmp(*argument, "--sessions") == 0 && argument[1] != nullptr) {
+            argument++;
+            session_count = atoi(*argument);
+        } else if (strcmp(*argument, "--delta") == 0) {
+            delta_encoding = true;
+        } else if (strcmp(*argument, "--preframed") == 0) {
+            preframed_writes = true;
+        } else if (
+            strcmp(*argument, "--radius") == 0 && argument[1] != nullptr
+        ) {
+            argument++;
+            interest_radius = atof(*argument);
+        } else if (
+            strcmp(*argument, "--far-users") == 0 && argument[1] != nullptr
+        ) {
+            argument++;
+            far_user_capacity = atoi(*argument);
+        } else if (
+            strcmp(*argument, "--budget") == 0 && argument[1] != nullptr
+        ) {
+            argument++;
+            message_byte_budget = atoi(*argument);
+        } else {
+            name = *argument;
+        }
+    }
+
+    if (name.empty() || name == "server-tick")
+        benchmark_server_tick();
+    if (name.empty() || name == "broadcast")
+        benchmark_broadcast();
+    if (name.empty() || name == "fixed-point")
+        benchmark_fixed_point();
+    if (name.empty() || name == "interest")
+        benchmark_interest();
+    if (name.empty() || name == "priority")
+        benchmark_priority();
+    if (name.empty() || name == "compression")
+        benchmark_compression();
+    if (name.empty() || name == "model-loading")
+        benchmark_model_loading();
+    if (name.empty() || name == "instancing")
+        benchmark_instancing();
+    if (name.empty() || name == "model-conversion")
+        check_model_conversion();
+
+    return failed ? 1 : 0;
+}
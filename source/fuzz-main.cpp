@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <exception>
+
+#include "network/network_message.h"
+
+// Feeds generated input to everything that reads messages from the network,
+// for libFuzzer. Run ./fuzz, optionally with a directory to keep the corpus in.
+// Crashes and sanitizer errors are bugs, exceptions aren't.
+
+const unsigned user_capacity = 16, audio_capacity = 200;
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, size_t size) {
+    std::span<const std::uint8_t> b(data, size);
+
+    // what the server does with messages from clients
+    static message room;
+    if (room.user_capacity == 0)
+        room.reset(user_capacity, audio_capacity);
+    message_view view;
+    if (view.parse(b, {1, audio_capacity}) == read_error::none) {
+        room.clear();
+        room.append(view);
+    }
+
+    // every accessor of anything that parses
+    if (view.parse(b) == read_error::none) {
+        float sum = 0;
+        for (auto user = 0u; user < view.size; user++) {
+            sum += view.id(user);
+            for (auto value : view.position(user))
+                sum += value;
+            for (auto value : view.orientation(user))
+                sum += value;
+        }
+        for (auto voice : view.voices)
+            for (auto byte : voice)
+                sum += byte;
+        // so that the accessors aren't optimized away
+        volatile float result = sum;
+        (void)result;
+    }
+
+    // What clients do with ticks, which may throw. The history is kept, so
+    // later inputs can be delta encoded against earlier ones.
+    std::vector<std::uint8_t> copy(data, data + size);
+    static message tick;
+    static pose_history history;
+    if (tick.user_capacity == 0) {
+        tick.reset(user_capacity, audio_capacity);
+        history.reset(4, user_capacity);
+    }
+    try {
+        read(tick, copy, history);
+    } catch (const std::exception &) {
+    }
+
+    // what the server does with handshakes
+    initial_message initial(4);
+    parse(initial, b);
+    try {
+        read(initial, copy);
+    } catch (const std::exception &) {
+    }
+
+    return 0;
+}
@@ -46,9 +46,9 @@ void hello::draw(VkInstance instance, VkSurfaceKHR surface) {
     }
 }
 
-void hello::update(input& input) {
+void hello::update(input& input, float delta) {
     scope_trace trace;
-    client->update(input);
+    client->update(input, delta);
 
     try {
         audio->update(*client);
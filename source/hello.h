@@ -11,7 +11,8 @@ struct hello {
     hello(char *arguments[], VkInstance instance, VkSurfaceKHR surface);
 
     void draw(VkInstance instance, VkSurfaceKHR surface);
-    void update(::input& input);
+    // delta is the time since the last frame, in seconds
+    void update(::input& input, float delta);
 
     std::unique_ptr<::client> client;
     std::unique_ptr<::visuals> visuals;
@@ -0,0 +1,307 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <optional>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include "server/server.h"
+#include "network/network_message.h"
+#include "utility/opus_resource.h"
+
+// Connects any number of bots to a running server, which send poses and voice
+// like hello-vk does, and reports how regularly ticks arrive. Runs without a
+// window or a GPU.
+
+using namespace std::chrono;
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+
+std::string host = "127.0.0.1";
+unsigned short port = 28750;
+unsigned bot_count = 100;
+unsigned duration_seconds = 10;
+// the client sends every 50 ms
+milliseconds send_interval{50};
+// needs to be longer than the server's history, like the client's
+unsigned received_history_length = 32;
+// bots that don't subscribe to voice still send it
+bool receive_voice = true;
+
+struct statistics {
+    std::atomic_uint64_t
+        connected_count = 0, tick_count = 0, dropped_tick_count = 0,
+        received_byte_count = 0, sent_byte_count = 0, error_count = 0;
+    // deviation of the time between two ticks from the tick time
+    std::atomic_uint64_t jitter_total = 0, jitter_maximum = 0;
+};
+
+statistics total;
+
+// Voice packets are encoded once from a tone and then sent by all bots in turn
+std::vector<std::vector<std::uint8_t>> canned_voice;
+
+void encode_canned_voice() {
+    int error;
+    unique_opus_encoder encoder =
+        opus_encoder_create(48000, 1, OPUS_APPLICATION_VOIP, &error);
+    opus_check(error);
+
+    // 60 ms per packet, like the client's capture buffer
+    std::int16_t samples[2880];
+    unsigned sample_count = 0;
+    for (auto packet = 0u; packet < 16; packet++) {
+        for (auto &sample : samples) {
+            sample = std::int16_t(
+                std::sin(sample_count * 220.f * 2 * 3.14159265f / 48000) *
+                0.1f * 32767
+            );
+            sample_count++;
+        }
+        std::vector<std::uint8_t> packet_data(message_audio_capacity);
+        packet_data.resize(opus_check(opus_encode(
+            encoder.get(), samples, std::size(samples),
+            packet_data.data(), packet_data.size()
+        )));
+        canned_voice.push_back(std::move(packet_data));
+    }
+}
+
+void maximum(std::atomic_uint64_t &value, std::uint64_t other) {
+    auto current = value.load();
+    while (current < other && !value.compare_exchange_weak(current, other));
+}
+
+asio::awaitable<void> receive(
+    std::shared_ptr<beast::websocket::stream<asio::ip::tcp::socket>> stream,
+    std::shared_ptr<std::atomic_uint32_t> last_tick, bool voice
+) {
+    boost::system::error_code error;
+    auto completion_token = asio::redirect_error(asio::use_awaitable, error);
+    beast::flat_buffer buffer;
+
+    message m;
+    m.reset(message_user_capacity, message_audio_capacity);
+    m.voice = voice;
+    pose_history history;
+    history.reset(received_history_length, message_user_capacity);
+
+    std::optional<steady_clock::time_point> last_arrival;
+    while (true) {
+        auto size = co_await stream->async_read(buffer, completion_token);
+        if (error)
+            break;
+        auto arrival = steady_clock::now();
+
+        try {
+            // the voices aren't played, so they aren't copied
+            read_poses(
+                m, {static_cast<std::uint8_t*>(buffer.data().data()), size},
+                history
+            );
+        } catch (const std::exception &) {
+            total.error_count++;
+            break;
+        }
+        buffer.consume(buffer.size());
+
+        total.tick_count++;
+        total.received_byte_count += size;
+        if (*last_tick != 0 && m.tick > *last_tick + 1)
+            total.dropped_tick_count += m.tick - *last_tick - 1;
+        *last_tick = m.tick;
+
+        if (last_arrival) {
+            auto jitter = std::abs(
+                duration_cast<microseconds>(
+                    arrival - *last_arrival - tick_time
+                ).count()
+            );
+            total.jitter_total += jitter;
+            maximum(total.jitter_maximum, jitter);
+        }
+        last_arrival = arrival;
+    }
+}
+
+asio::awaitable<void> bot(unsigned index) {
+    boost::system::error_code error;
+    auto completion_token = asio::redirect_error(asio::use_awaitable, error);
+    auto executor = co_await asio::this_coro::executor;
+
+    auto stream = std::make_shared<
+        beast::websocket::stream<asio::ip::tcp::socket>
+    >(executor);
+    co_await stream->next_layer().async_connect(
+        {asio::ip::make_address(host), port}, completion_token
+    );
+    if (!error)
+        co_await stream->async_handshake(host, "/", completion_token);
+    if (error) {
+        total.error_count++;
+        co_return;
+    }
+    stream->binary(true);
+
+    auto request = handshake_request(receive_voice);
+    std::vector<std::uint8_t> buffer(capacity(request));
+    co_await stream->async_write(
+        asio::buffer(buffer.data(), write(request, buffer)), completion_token
+    );
+    beast::flat_buffer response_buffer;
+    if (!error)
+        co_await stream->async_read(response_buffer, completion_token);
+    initial_message response(8);
+    if (
+        error ||
+        parse(
+            response,
+            {
+                static_cast<const std::uint8_t*>(response_buffer.data().data()),
+                response_buffer.size()
+            }
+        ) != read_error::none
+    ) {
+        total.error_count++;
+        co_return;
+    }
+    total.connected_count++;
+
+    auto last_tick = std::make_shared<std::atomic_uint32_t>(0);
+    // on the bot's strand, like the writes
+    co_spawn(
+        executor,
+        receive(stream, last_tick, has_extension(response, extensions::voice)),
+        asio::detached
+    );
+
+    message m;
+    m.reset(1, message_audio_capacity);
+    m.users.size = 1;
+    buffer.resize(capacity(m));
+
+    // walk in circles around the origin, each bot at its own distance
+    float radius = 1 + index * 0.05f;
+    asio::steady_timer timer(executor, steady_clock::now());
+    for (unsigned t = 0; !error; t++) {
+        float angle = (index + t) * 0.05f / radius;
+        m.users.position[0] = std::cos(angle) * radius;
+        m.users.position[2] = std::sin(angle) * radius;
+        m.users.orientation[1] = std::sin(-angle / 2);
+        m.users.orientation[3] = std::cos(-angle / 2);
+
+        auto &voice = canned_voice[(index + t) % canned_voice.size()];
+        m.users.voice[0].first = voice.size();
+        std::copy(voice.begin(), voice.end(), m.users.voice[0].second.begin());
+
+        // acknowledge the last tick, so the server can send deltas
+        m.tick = *last_tick;
+        auto size = write(m, buffer);
+        co_await stream->async_write(
+            asio::buffer(buffer.data(), size), completion_token
+        );
+        total.sent_byte_count += size;
+
+        timer.expires_at(timer.expiry() + send_interval);
+        co_await timer.async_wait(completion_token);
+    }
+    total.connected_count--;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned thread_count = 1;
+    for (auto argument = argv + 1; *argument != nullptr; argument++) {
+        if (strcmp(*argument, "--host") == 0 && argument[1] != nullptr) {
+            argument++;
+            host = *argument;
+        } else if (strcmp(*argument, "--port") == 0 && argument[1] != nullptr) {
+            argument++;
+            port = atoi(*argument);
+        } else if (strcmp(*argument, "--bots") == 0 && argument[1] != nullptr) {
+            argument++;
+            bot_count = atoi(*argument);
+        } else if (
+            strcmp(*argument, "--duration") == 0 && argument[1] != nullptr
+        ) {
+            argument++;
+            duration_seconds = atoi(*argument);
+        } else if (
+            strcmp(*argument, "--threads") == 0 && argument[1] != nullptr
+        ) {
+            argument++;
+            thread_count = std::max(1, atoi(*argument));
+        } else if (strcmp(*argument, "--no-voice") == 0) {
+            receive_voice = false;
+        }
+    }
+
+    encode_canned_voice();
+
+    asio::io_context context(thread_count);
+    // Each bot reads and writes its stream from its own strand, a stream
+    // can't be used from several threads at once
+    for (auto i = 0u; i < bot_count; i++)
+        co_spawn(asio::make_strand(context), bot(i), asio::detached);
+
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < thread_count; i++)
+        threads.emplace_back([&context](){ context.run(); });
+
+    printf(
+        "%u bots connecting to %s:%u.\n", bot_count, host.c_str(),
+        unsigned(port)
+    );
+    printf(
+        "second, connected, ticks per bot, dropped ticks, "
+        "mean jitter (ms), maximum jitter (ms), received (kB/s), "
+        "sent (kB/s), errors\n"
+    );
+
+    std::uint64_t
+        tick_count = 0, dropped_tick_count = 0, received_byte_count = 0,
+        sent_byte_count = 0, jitter_total = 0;
+    for (auto second = 1u; second <= duration_seconds; second++) {
+        std::this_thread::sleep_for(seconds(1));
+
+        // differences to the last second
+        auto difference = [](std::atomic_uint64_t &value, std::uint64_t &last) {
+            std::uint64_t current = value;
+            auto difference = current - last;
+            last = current;
+            return difference;
+        };
+        std::uint64_t connected_count = total.connected_count;
+        auto ticks = difference(total.tick_count, tick_count);
+        auto dropped_ticks =
+            difference(total.dropped_tick_count, dropped_tick_count);
+        auto received_bytes =
+            difference(total.received_byte_count, received_byte_count);
+        auto sent_bytes = difference(total.sent_byte_count, sent_byte_count);
+        auto jitter = difference(total.jitter_total, jitter_total);
+
+        printf(
+            "%u, %llu, %.1f, %llu, %.2f, %.2f, %.1f, %.1f, %llu\n", second,
+            (long long unsigned)connected_count,
+            double(ticks) / std::max<std::uint64_t>(1, connected_count),
+            (long long unsigned)dropped_ticks,
+            jitter / 1000.0 / std::max<std::uint64_t>(1, ticks),
+            total.jitter_maximum.exchange(0) / 1000.0,
+            received_bytes / 1000.0, sent_bytes / 1000.0,
+            (long long unsigned)total.error_count.load()
+        );
+        fflush(stdout);
+    }
+
+    context.stop();
+    for (auto &thread : threads)
+        thread.join();
+
+    return 0;
+}
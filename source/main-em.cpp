@@ -191,7 +191,7 @@ EM_BOOL request_animation_frame(double time, void* userData) {
         key_down[1] ? 1 : 0,
         key_down[0] ? -1 :
         key_down[2] ? 1 : 0,
-    } * delta;
+    };
 
     mouse_rotation = {};
 
@@ -206,11 +206,11 @@ EM_BOOL request_animation_frame(double time, void* userData) {
                 continue;
 
             input.rotation += deadzone({event.axis[2], event.axis[3]}) * delta;
-            input.motion += deadzone({event.axis[0], event.axis[1]}) * delta;
+            input.motion += deadzone({event.axis[0], event.axis[1]});
         }
     }
 
-    h->update(input);
+    h->update(input, delta);
     h->draw(vglCreateInstanceForGL(), vglCreateSurfaceForGL());
 
     return EM_TRUE;
@@ -89,7 +89,7 @@ int main(int argc, char *argv[]) {
 
         update(input, window.get(), delta);
 
-        h.update(input);
+        h.update(input, delta);
         h.draw(vglCreateInstanceForGL(), vglCreateSurfaceForGL());
 
         glfwSwapBuffers(window.get());
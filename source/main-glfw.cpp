@@ -26,7 +26,7 @@ void update(input& input, GLFWwindow* window, float delta) {
         glfwGetKey(window, GLFW_KEY_D) ? 1 : 0,
         glfwGetKey(window, GLFW_KEY_W) ? -1 :
         glfwGetKey(window, GLFW_KEY_S) ? 1 : 0,
-    } * delta;
+    };
 
     if (glfwJoystickIsGamepad(GLFW_JOYSTICK_1)) {
         // TODO: maybe separate mouse motion from joystick motion in ::input
@@ -40,7 +40,7 @@ void update(input& input, GLFWwindow* window, float delta) {
             input.motion += deadzone({
                 state.axes[GLFW_GAMEPAD_AXIS_LEFT_X],
                 state.axes[GLFW_GAMEPAD_AXIS_LEFT_Y]
-            }) * delta;
+            });
         }
     }
 
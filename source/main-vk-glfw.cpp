@@ -148,7 +148,7 @@ int main(int argc, char *argv[]) {
 
         update(input, window.get(), delta);
 
-        h.update(input);
+        h.update(input, delta);
         h.draw(instance.get(), surface.get());
 
         glfwPollEvents();
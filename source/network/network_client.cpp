@@ -7,13 +7,16 @@
 
 void put_message(client& client, const char* buffer, size_t size) {
     scope_trace trace;
-    if (!client.message_in_readable) {
-        client.in_buffer.resize(size);
-        std::move(buffer, buffer + size, client.in_buffer.data());
-        client.message_in_readable = true;
-
-    } else {
+    auto frame = client.in_frames.back();
+    if (!frame) {
+        client.in_overrun_count++;
+        return;
     }
+    // the slot keeps its capacity, usually nothing is allocated
+    frame->buffer.assign(buffer, buffer + size);
+    frame->arrival = std::chrono::steady_clock::now();
+    client.in_frames.push();
+    client.in_frame_count++;
 }
 
 void set_disconnected(client& client) {
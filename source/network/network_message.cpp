@@ -1,8 +1,13 @@
 #include "network_message.h"
 
 #include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <utility>
 
 #include "../utility/serialization.h"
+#include "../utility/fixed_point.h"
 
 template<class F>
 void apply(uuid &m, F f) {
@@ -10,33 +15,496 @@ void apply(uuid &m, F f) {
     apply(m.values[1], f);
 }
 
-template<class A, class B, class F>
-void apply(std::pair<A, B> &p, F f) {
-    apply(p.first, f);
-    apply(p.first, p.second, f);
-}
-
 template<class F>
 void apply(initial_message &m, F f) {
     apply(m.size, f);
     apply(m.size, m.extensions, f);
+    apply(m.audio_capacity, f);
 }
 
-template<class F>
-void apply(message &m, F f) {
-    apply(m.users.size, f);
-    apply_fixed_point<int16_t, 8, float>(m.users.size * 3, m.users.position, f);
-    apply_fixed_point<int16_t, 15, float>(
-        m.users.size * 4, m.users.orientation, f
+// The encoder and decoder below follow the layout tables. They check the size
+// of the buffer once per section instead of once per value.
+
+static_assert(
+    message_user_layout[0].size == sizeof(std::uint16_t) &&
+    message_user_layout[0].encoding == wire_encoding::integer
+);
+static_assert(
+    message_user_layout[1].size == sizeof(std::int16_t) &&
+    message_user_layout[1].count == 3 &&
+    message_user_layout[1].encoding == wire_encoding::position
+);
+static_assert(
+    message_user_layout[2].size == sizeof(std::uint32_t) &&
+    message_user_layout[2].encoding == wire_encoding::smallest_three
+);
+
+template<std::unsigned_integral T>
+std::uint8_t *store(std::uint8_t *out, T value) {
+    // network byte order is big-endian
+    for (size_t i = 0; i < sizeof(T); i++)
+        out[i] = std::uint8_t(value >> ((sizeof(T) - i - 1) * 8));
+    return out + sizeof(T);
+}
+
+template<std::unsigned_integral T>
+const std::uint8_t *load(const std::uint8_t *in, T &value) {
+    value = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        value = T(value << 8 | in[i]);
+    return in + sizeof(T);
+}
+
+float position_scale(const position_bounds &bounds) {
+    return float(1u << bounds.mantissa_bits);
+}
+
+// truncates towards zero, like write_int16_fixed_point
+std::int32_t quantize_position(
+    const position_bounds &bounds, float value, unsigned axis
+) {
+    auto relative = value - float(bounds.origin[axis]);
+    return std::int16_t(
+        std::clamp(relative * position_scale(bounds), -32768.f, 32767.f)
+    );
+}
+
+float dequantize_position(
+    const position_bounds &bounds, std::int32_t value, unsigned axis
+) {
+    return value / position_scale(bounds) + float(bounds.origin[axis]);
+}
+
+const std::uint32_t orientation_component_mask =
+    (1u << orientation_component_bits) - 1;
+// steps on each side of 0, so that 0 is exact
+const std::int32_t orientation_component_steps =
+    (1 << (orientation_component_bits - 1)) - 1;
+const float sqrt_2 = 1.41421356f;
+
+// index and components as separate values, for delta encoding
+void split_orientation(std::uint32_t compressed, std::int32_t *values) {
+    values[0] = compressed >> (3 * orientation_component_bits) & 3;
+    for (unsigned i = 0; i < 3; i++)
+        values[1 + i] =
+            compressed >> ((2 - i) * orientation_component_bits) &
+            orientation_component_mask;
+}
+
+std::uint32_t join_orientation(const std::int32_t *values) {
+    std::uint32_t compressed = values[0] & 3;
+    for (unsigned i = 0; i < 3; i++)
+        compressed =
+            compressed << orientation_component_bits |
+            (values[1 + i] & orientation_component_mask);
+    return compressed;
+}
+
+std::uint32_t compress_orientation(const float *quaternion) {
+    float length = 0;
+    unsigned largest = 0;
+    for (unsigned i = 0; i < 4; i++) {
+        length += quaternion[i] * quaternion[i];
+        if (std::abs(quaternion[i]) > std::abs(quaternion[largest]))
+            largest = i;
+    }
+    length = std::sqrt(length);
+    if (!(length > 0) || !std::isfinite(length)) {
+        // anything that isn't a rotation becomes the identity
+        const std::int32_t identity[] {
+            3, orientation_component_steps, orientation_component_steps,
+            orientation_component_steps
+        };
+        return join_orientation(identity);
+    }
+
+    // the largest component is positive and the others at most 1/sqrt(2)
+    float scale = (quaternion[largest] < 0 ? -sqrt_2 : sqrt_2) / length;
+    std::uint32_t compressed = largest;
+    for (unsigned i = 0; i < 4; i++) {
+        if (i == largest)
+            continue;
+        // rounded to the nearest step, which is never negative
+        auto component =
+            (std::clamp(quaternion[i] * scale, -1.f, 1.f) + 1) *
+            orientation_component_steps + 0.5f;
+        compressed =
+            compressed << orientation_component_bits |
+            std::uint32_t(component);
+    }
+    return compressed;
+}
+
+void decompress_orientation(std::uint32_t compressed, float *quaternion) {
+    unsigned largest = compressed >> (3 * orientation_component_bits) & 3;
+    float sum = 0;
+    for (int i = 3; i >= 0; i--) {
+        if (unsigned(i) == largest)
+            continue;
+        auto component =
+            std::int32_t(compressed & orientation_component_mask) -
+            orientation_component_steps;
+        compressed >>= orientation_component_bits;
+        quaternion[i] = component / (orientation_component_steps * sqrt_2);
+        sum += quaternion[i] * quaternion[i];
+    }
+    quaternion[largest] = std::sqrt(std::max(0.f, 1 - sum));
+}
+
+std::uint8_t *write_positions(const message &m, std::uint8_t *out) {
+    auto values = m.users.position.values.get();
+    std::size_t size = m.users.size * 3u;
+    // relative to the origin, in batches that fit on the stack
+    float relative[3 * 64];
+    for (std::size_t begin = 0; begin < size; begin += std::size(relative)) {
+        auto count = std::min(std::size(relative), size - begin);
+        for (std::size_t i = 0; i < count; i++)
+            relative[i] =
+                values[begin + i] - float(m.bounds.origin[(begin + i) % 3]);
+        write_int16_fixed_point(
+            relative, count, position_scale(m.bounds), out + begin * 2
+        );
+    }
+    return out + size * 2;
+}
+
+const std::uint8_t *read_positions(message &m, const std::uint8_t *in) {
+    auto values = m.users.position.values.get();
+    std::size_t size = m.users.size * 3u;
+    read_int16_fixed_point(in, size, position_scale(m.bounds), values);
+    auto &origin = m.bounds.origin;
+    if (origin[0] != 0 || origin[1] != 0 || origin[2] != 0)
+        for (std::size_t i = 0; i < size; i++)
+            values[i] += float(origin[i % 3]);
+    return in + size * 2;
+}
+
+std::uint8_t *write_header(const message &m, std::uint8_t *out) {
+    out = store(out, m.tick);
+    out = store(out, m.baseline_tick);
+    return store(out, m.users.size);
+}
+
+std::uint8_t *write_users(const message &m, std::uint8_t *out) {
+    for (unsigned user = 0; user < m.users.size; user++)
+        out = store(out, m.users.id.values[user]);
+    out = write_positions(m, out);
+    for (unsigned user = 0; user < m.users.size; user++)
+        out = store(
+            out,
+            compress_orientation(m.users.orientation.values.get() + user * 4)
+        );
+    return out;
+}
+
+std::size_t voice_size(const message &m) {
+    std::size_t size = 0;
+    if (!m.voice)
+        return size;
+    for (unsigned user = 0; user < m.users.size; user++)
+        size += message_voice_layout.size + m.users.voice.values[user].first;
+    return size;
+}
+
+std::uint8_t *write_voice(const message &m, std::uint8_t *out) {
+    if (!m.voice)
+        return out;
+    for (unsigned user = 0; user < m.users.size; user++) {
+        auto &voice = m.users.voice.values[user];
+        out = store(out, voice.first);
+        out = std::copy_n(voice.second.values.get(), voice.first, out);
+    }
+    return out;
+}
+
+void read_header(message &m, std::span<std::uint8_t> &b) {
+    if (b.size() < message_header_size)
+        throw std::overflow_error("message truncated");
+    auto in = load(b.data(), m.tick);
+    in = load(in, m.baseline_tick);
+    load(in, m.users.size);
+    b = b.subspan(message_header_size);
+    // Each user needs at least the size of its voice, or the two bits of an
+    // unchanged delta encoded pose. Checked before a crafted size can make the
+    // message grow.
+    auto minimum_size = m.voice ?
+        m.users.size * message_voice_layout.size : (m.users.size * 2u + 7) / 8;
+    if (b.size() < minimum_size)
+        throw std::overflow_error("message truncated");
+    m.reserve(m.users.size);
+}
+
+// fills in the poses of snapshot as they were sent, if there is one
+void read_users(
+    message &m, std::span<std::uint8_t> &b, pose_snapshot *snapshot = nullptr
+) {
+    auto size = m.users.size * message_user_size;
+    if (b.size() < size)
+        throw std::overflow_error("message truncated");
+    const std::uint8_t *in = b.data();
+    for (unsigned user = 0; user < m.users.size; user++)
+        in = load(in, m.users.id.values[user]);
+    if (snapshot) {
+        std::copy_n(
+            m.users.id.values.get(), m.users.size, snapshot->id.begin()
+        );
+        for (unsigned i = 0; i < m.users.size * 3u; i++) {
+            std::uint16_t position;
+            load(in + i * 2, position);
+            snapshot->position[i] = std::int16_t(position);
+        }
+    }
+    in = read_positions(m, in);
+    for (unsigned user = 0; user < m.users.size; user++) {
+        std::uint32_t compressed;
+        in = load(in, compressed);
+        decompress_orientation(
+            compressed, m.users.orientation.values.get() + user * 4
+        );
+        if (snapshot) {
+            std::int32_t values[4];
+            split_orientation(compressed, values);
+            std::copy_n(values, 4, snapshot->orientation.begin() + user * 4);
+        }
+    }
+    b = b.subspan(size);
+}
+
+void check(read_error error) {
+    switch (error) {
+    case read_error::none:
+        return;
+    case read_error::truncated:
+        throw std::overflow_error("message truncated");
+    case read_error::too_large:
+        throw std::length_error("message too large");
+    case read_error::delta_encoded:
+        throw std::runtime_error("delta encoded messages can't be viewed");
+    }
+}
+
+// checks that b starts with the voices of size users
+read_error view_voices(
+    std::span<const std::uint8_t> b, unsigned size, unsigned audio_capacity,
+    voice_view &voices
+) {
+    std::size_t offset = 0;
+    for (unsigned user = 0; user < size; user++) {
+        if (b.size() - offset < message_voice_layout.size)
+            return read_error::truncated;
+        std::uint16_t voice_size;
+        load(b.data() + offset, voice_size);
+        offset += message_voice_layout.size;
+        if (voice_size > audio_capacity)
+            return read_error::too_large;
+        if (b.size() - offset < voice_size)
+            return read_error::truncated;
+        offset += voice_size;
+    }
+    voices = {b.first(offset)};
+    return read_error::none;
+}
+
+// none if the messages have no voice
+voice_view view_voices(const message &m, std::span<const std::uint8_t> b) {
+    voice_view voices;
+    if (m.voice)
+        check(view_voices(b, m.users.size, 0xffff, voices));
+    return voices;
+}
+
+void copy_voice(
+    message &m, unsigned user, std::span<const std::uint8_t> voice
+) {
+    auto &destination = m.users.voice.values[user];
+    // make room for whatever the other side sent
+    if (voice.size() > destination.second.capacity) {
+        destination.second.reset(voice.size());
+        m.audio_capacity = std::max<unsigned>(m.audio_capacity, voice.size());
+    }
+    destination.first = voice.size();
+    std::copy(voice.begin(), voice.end(), destination.second.values.get());
+}
+
+void read_voice(message &m, const voice_view &voices) {
+    unsigned user = 0;
+    for (auto voice : voices)
+        copy_voice(m, user++, voice);
+    // users of messages without voice are silent
+    for (; user < m.users.size; user++)
+        m.users.voice[user].first = 0;
+}
+
+std::span<const std::uint8_t> voice_view::iterator::operator*() const {
+    std::uint16_t size;
+    load(at, size);
+    return {at + message_voice_layout.size, size};
+}
+
+voice_view::iterator &voice_view::iterator::operator++() {
+    auto voice = **this;
+    at = voice.data() + voice.size();
+    return *this;
+}
+
+message_view::message_view(
+    std::span<const std::uint8_t> b, const position_bounds &bounds
+) {
+    check(parse(b, {}, bounds));
+}
+
+read_error message_view::parse(
+    std::span<const std::uint8_t> b, const read_limits &limits,
+    const position_bounds &bounds
+) {
+    this->bounds = bounds;
+    if (b.size() < message_header_size)
+        return read_error::truncated;
+    auto in = load(b.data(), tick);
+    in = load(in, baseline_tick);
+    load(in, size);
+    if (baseline_tick != 0)
+        return read_error::delta_encoded;
+    if (size > limits.user_capacity)
+        return read_error::too_large;
+    b = b.subspan(message_header_size);
+
+    // each user needs at least the size of its voice
+    auto users_size = size * message_user_size;
+    if (b.size() < users_size + size * message_voice_layout.size)
+        return read_error::truncated;
+    users = b.data();
+    return view_voices(
+        b.subspan(users_size), size, limits.audio_capacity, voices
     );
-    apply(m.users.size, m.users.voice, f);
+}
+
+std::uint16_t message_view::id(unsigned user) const {
+    std::uint16_t id;
+    load(users + user * message_user_layout[0].size, id);
+    return id;
+}
+
+std::array<float, 3> message_view::position(unsigned user) const {
+    auto &field = message_user_layout[1];
+    auto in =
+        users + size * layout_size(message_user_layout, 1) +
+        user * field.size * field.count;
+    std::array<float, 3> position;
+    for (unsigned axis = 0; axis < 3; axis++) {
+        std::uint16_t value;
+        in = load(in, value);
+        position[axis] =
+            dequantize_position(bounds, std::int16_t(value), axis);
+    }
+    return position;
+}
+
+std::array<float, 4> message_view::orientation(unsigned user) const {
+    std::uint32_t compressed;
+    load(
+        users + size * layout_size(message_user_layout, 2) +
+            user * message_user_layout[2].size,
+        compressed
+    );
+    std::array<float, 4> orientation;
+    decompress_orientation(compressed, orientation.data());
+    return orientation;
+}
+
+// Deltas are zigzag encoded and stored with one of four widths, selected by a
+// two bit prefix. A change of a 16 bit value needs at most 17 bits.
+const unsigned delta_widths[] = {4, 8, 12, 17};
+// three positions and the four values of split_orientation
+const unsigned pose_fields = 7;
+// Delta encoding may use more space than absolute encoding in the worst case.
+// The id takes a bit more, the pose a change bit, mask and deltas.
+const unsigned delta_overhead_bits =
+    1 + 1 + pose_fields + pose_fields * (2 + 17) -
+    (message_user_size - sizeof(std::uint16_t)) * 8;
+
+void write_delta(std::int32_t delta, bit_write_tag_t &write) {
+    std::uint32_t zigzag = (std::uint32_t(delta) << 1) ^ (delta >> 31);
+    unsigned width = 0;
+    while (zigzag >= (1u << delta_widths[width]))
+        width++;
+    apply_bits(width, 2, write);
+    apply_bits(zigzag, delta_widths[width], write);
+}
+
+std::int32_t read_delta(bit_read_tag_t &read) {
+    unsigned width;
+    std::uint32_t zigzag;
+    apply_bits(width, 2, read);
+    apply_bits(zigzag, delta_widths[width], read);
+    return std::int32_t(zigzag >> 1) ^ -std::int32_t(zigzag & 1);
+}
+
+void quantize_pose(
+    message &m, unsigned user, std::int32_t (&pose)[pose_fields]
+) {
+    for (unsigned i = 0; i < 3; i++)
+        pose[i] = quantize_position(
+            m.bounds, m.users.position[user * 3 + i], i
+        );
+    split_orientation(
+        compress_orientation(m.users.orientation.values.get() + user * 4),
+        pose + 3
+    );
+}
+
+// index of the user with the id in the baseline, usually still at the same
+// index, or -1
+int find_user(const pose_snapshot &baseline, std::uint16_t id, unsigned hint) {
+    if (hint < baseline.size && baseline.id.values[hint] == id)
+        return hint;
+    for (unsigned user = 0; user < baseline.size; user++)
+        if (baseline.id.values[user] == id)
+            return user;
+    return -1;
+}
+
+void baseline_pose(
+    const pose_snapshot &baseline, int user, std::int32_t (&pose)[pose_fields]
+) {
+    // users that are new since the baseline are encoded relative to zero
+    bool present = user >= 0;
+    for (unsigned i = 0; i < 3; i++)
+        pose[i] = present ? baseline.position.values[user * 3 + i] : 0;
+    for (unsigned i = 0; i < 4; i++)
+        pose[3 + i] = present ? baseline.orientation.values[user * 4 + i] : 0;
 }
 
 initial_message::initial_message(unsigned int extension_capacity) {
     extensions = {extension_capacity};
 }
 
+bool has_extension(const initial_message &m, const uuid &extension) {
+    for (unsigned i = 0; i < m.size; i++)
+        if (m.extensions.values[i] == extension)
+            return true;
+    return false;
+}
+
+void add_extension(initial_message &m, const uuid &extension) {
+    if (m.size == m.extensions.capacity)
+        throw std::length_error("too many extensions");
+    m.extensions[m.size++] = extension;
+}
+
+initial_message handshake_request(bool voice) {
+    initial_message request(4);
+    add_extension(request, extensions::pose);
+    add_extension(request, extensions::user);
+    if (voice)
+        add_extension(request, extensions::voice);
+    add_extension(request, extensions::delta_pose);
+    request.audio_capacity = 0xffff;
+    return request;
+}
+
 void message::reset(unsigned user_capacity, unsigned audio_capacity) {
+    users.id.reset(user_capacity);
     users.position.reset(user_capacity * 3);
     users.orientation.reset(user_capacity * 4);
     users.voice.reset(user_capacity);
@@ -47,30 +515,121 @@ void message::reset(unsigned user_capacity, unsigned audio_capacity) {
     this->audio_capacity = audio_capacity;
 }
 
+template<class T>
+void grow(unique_span<T> &span, unsigned capacity) {
+    unique_span<T> grown(capacity);
+    std::move(span.begin(), span.end(), grown.begin());
+    span = std::move(grown);
+}
+
+void message::reserve(unsigned user_capacity) {
+    if (user_capacity <= this->user_capacity)
+        return;
+    grow(users.id, user_capacity);
+    grow(users.position, user_capacity * 3);
+    grow(users.orientation, user_capacity * 4);
+    grow(users.voice, user_capacity);
+    for (auto user = this->user_capacity; user < user_capacity; user++)
+        users.voice[user].second.reset(audio_capacity);
+    this->user_capacity = user_capacity;
+}
+
 void message::clear() {
     users.size = 0;
 }
 
-template<class T>
-void append(
-    unique_span<T> &d, const unique_span<T> &s, 
-    size_t offset
-) {
-    copy(
-        std::ranges::subrange(s.begin(), s.end()),
-        std::ranges::subrange(d.begin() + offset, d.end())
-    );
+void pose_history::reset(unsigned length, unsigned user_capacity) {
+    snapshots.reset(length);
+    for (auto &snapshot : snapshots) {
+        snapshot.id.reset(user_capacity);
+        snapshot.position.reset(user_capacity * 3);
+        snapshot.orientation.reset(user_capacity * 4);
+    }
+    next = 0;
 }
 
-void message::append(const message &other) {
-    ::append(users.position, other.users.position, users.size * 3);
-    ::append(users.orientation, other.users.orientation, users.size * 4);
-    ::append(users.voice, other.users.voice, users.size);
-    users.size += other.users.size;
+void reserve(pose_snapshot &snapshot, std::uint32_t tick, std::uint16_t size) {
+    snapshot.tick = tick;
+    snapshot.size = size;
+    if (snapshot.id.size() < size) {
+        snapshot.id.reset(size);
+        snapshot.position.reset(size * 3);
+        snapshot.orientation.reset(size * 4);
+    }
+}
+
+void pose_history::push(const message &m) {
+    auto &snapshot = snapshots[next];
+    next = (next + 1) % snapshots.size();
+
+    reserve(snapshot, m.tick, m.users.size);
+    std::copy_n(m.users.id.begin(), snapshot.size, snapshot.id.begin());
+    for (unsigned i = 0; i < snapshot.size * 3u; i++)
+        snapshot.position[i] =
+            quantize_position(m.bounds, m.users.position.values[i], i % 3);
+    for (unsigned user = 0; user < snapshot.size; user++) {
+        std::int32_t values[4];
+        split_orientation(
+            compress_orientation(m.users.orientation.values.get() + user * 4),
+            values
+        );
+        std::copy_n(values, 4, snapshot.orientation.begin() + user * 4);
+    }
 }
 
-void write(initial_message &m, std::span<std::uint8_t> b) {
-    apply(m, write_tag_t{b});
+const pose_snapshot *pose_history::find(std::uint32_t tick) const {
+    if (tick == 0)
+        return nullptr;
+    for (auto &snapshot : snapshots)
+        if (snapshot.tick == tick)
+            return &snapshot;
+    return nullptr;
+}
+
+void message::append(const message_view &other) {
+    unsigned size = users.size + other.size;
+    if (size > user_capacity)
+        reserve(std::max(size, user_capacity * 2));
+    auto voice = other.voices.begin();
+    for (unsigned user = 0; user < other.size; user++, ++voice) {
+        auto index = users.size + user;
+        users.id[index] = other.id(user);
+        auto position = other.position(user);
+        std::copy(
+            position.begin(), position.end(),
+            users.position.begin() + index * 3
+        );
+        auto orientation = other.orientation(user);
+        std::copy(
+            orientation.begin(), orientation.end(),
+            users.orientation.begin() + index * 4
+        );
+        copy_voice(*this, index, *voice);
+    }
+    users.size = size;
+}
+
+void message::append(const message &other, unsigned user) {
+    if (users.size == user_capacity)
+        reserve(std::max(1u, user_capacity * 2));
+    users.id[users.size] = other.users.id.values[user];
+    std::copy_n(
+        other.users.position.begin() + user * 3, 3,
+        users.position.begin() + users.size * 3
+    );
+    std::copy_n(
+        other.users.orientation.begin() + user * 4, 4,
+        users.orientation.begin() + users.size * 4
+    );
+    auto &source = other.users.voice.values[user];
+    copy_voice(*this, users.size, {source.second.values.get(), source.first});
+    users.size++;
+}
+
+std::size_t write(initial_message &m, std::span<std::uint8_t> b) {
+    auto remaining = b;
+    apply(m, write_tag_t{remaining});
+    return b.size() - remaining.size();
 }
 
 void read(initial_message &m, std::span<std::uint8_t> b) {
@@ -83,16 +642,176 @@ std::size_t capacity(initial_message &m) {
     return size;
 }
 
-void write(message& m, std::span<uint8_t> b) {
-    apply(m, write_tag_t{b});
+read_error parse(initial_message &m, std::span<const std::uint8_t> b) {
+    std::uint16_t size;
+    if (b.size() < sizeof(size))
+        return read_error::truncated;
+    auto in = load(b.data(), size);
+    if (size > m.extensions.capacity)
+        return read_error::too_large;
+    if (
+        b.size() <
+        sizeof(size) + size * sizeof(uuid) + sizeof(m.audio_capacity)
+    )
+        return read_error::truncated;
+    m.size = size;
+    for (unsigned i = 0; i < size; i++) {
+        in = load(in, m.extensions[i].values[0]);
+        in = load(in, m.extensions[i].values[1]);
+    }
+    load(in, m.audio_capacity);
+    return read_error::none;
+}
+
+size_t write(message& m, std::span<uint8_t> b) {
+    m.baseline_tick = 0;
+    auto size =
+        message_header_size + m.users.size * message_user_size + voice_size(m);
+    if (b.size() < size)
+        throw std::overflow_error("message truncated");
+    write_voice(m, write_users(m, write_header(m, b.data())));
+    return size;
 }
 
 void read(message& m, std::span<uint8_t> b) {
-    apply(m, read_tag_t{b});
+    read_header(m, b);
+    read_users(m, b);
+    read_voice(m, view_voices(m, b));
 }
 
 size_t capacity(message& m) {
-    size_t size = 0;
-    apply(m, capacity_tag_t{size});
-    return size;
+    return
+        message_header_size +
+        m.user_capacity * (
+            message_user_size + message_voice_layout.size + m.audio_capacity
+        ) +
+        // enough for delta encoding too
+        (m.user_capacity * delta_overhead_bits + 7) / 8;
+}
+
+std::size_t header_size(const message &) {
+    return message_header_size;
+}
+
+std::size_t delta_user_overhead() {
+    return (delta_overhead_bits + 7) / 8;
+}
+
+std::size_t user_size(const message &m, unsigned user) {
+    if (!m.voice)
+        return message_user_size;
+    return
+        message_user_size + message_voice_layout.size +
+        m.users.voice.values[user].first;
+}
+
+size_t write(
+    message &m, std::span<uint8_t> b, const pose_snapshot &baseline
+) {
+    if (b.size() < message_header_size)
+        throw std::overflow_error("message truncated");
+    m.baseline_tick = baseline.tick;
+    write_header(m, b.data());
+    auto remaining = b.subspan(message_header_size);
+
+    bit_write_tag_t bits{remaining};
+    for (unsigned user = 0; user < m.users.size; user++) {
+        auto id = m.users.id[user];
+        bool same_id = user < baseline.size && baseline.id.values[user] == id;
+        apply_bits(unsigned(!same_id), 1, bits);
+        if (!same_id)
+            apply_bits(id, 16, bits);
+
+        std::int32_t pose[pose_fields], base[pose_fields];
+        quantize_pose(m, user, pose);
+        baseline_pose(baseline, find_user(baseline, id, user), base);
+
+        unsigned changed = 0;
+        for (unsigned i = 0; i < pose_fields; i++)
+            changed |= unsigned(pose[i] != base[i]) << i;
+
+        apply_bits(unsigned(changed != 0), 1, bits);
+        if (changed == 0)
+            continue;
+        apply_bits(changed, pose_fields, bits);
+        for (unsigned i = 0; i < pose_fields; i++)
+            if (changed & (1u << i))
+                write_delta(pose[i] - base[i], bits);
+    }
+    flush(bits);
+
+    if (remaining.size() < voice_size(m))
+        throw std::overflow_error("message truncated");
+    auto end = write_voice(m, remaining.data());
+    return end - b.data();
+}
+
+void read(message &m, std::span<uint8_t> b, pose_history &history) {
+    read_voice(m, read_poses(m, b, history));
+}
+
+voice_view read_poses(
+    message &m, std::span<uint8_t> b, pose_history &history
+) {
+    read_header(m, b);
+    auto &received = history.received;
+    reserve(received, m.tick, m.users.size);
+    auto push = [&]() {
+        std::swap(history.snapshots[history.next], received);
+        history.next = (history.next + 1) % history.snapshots.size();
+    };
+
+    if (m.baseline_tick == 0) {
+        read_users(m, b, &received);
+        auto voices = view_voices(m, b);
+        push();
+        return voices;
+    }
+
+    auto baseline = history.find(m.baseline_tick);
+    if (!baseline)
+        throw std::runtime_error("baseline missing");
+
+    bit_read_tag_t bits{b};
+    for (unsigned user = 0; user < m.users.size; user++) {
+        unsigned new_id = 0;
+        apply_bits(new_id, 1, bits);
+        std::uint16_t id = 0;
+        if (new_id)
+            apply_bits(id, 16, bits);
+        else if (user < baseline->size)
+            id = baseline->id.values[user];
+        else
+            throw std::runtime_error("user missing from baseline");
+        m.users.id[user] = id;
+        received.id[user] = id;
+
+        std::int32_t pose[pose_fields];
+        baseline_pose(*baseline, find_user(*baseline, id, user), pose);
+
+        unsigned changed = 0;
+        apply_bits(changed, 1, bits);
+        if (changed)
+            apply_bits(changed, pose_fields, bits);
+        for (unsigned i = 0; i < pose_fields; i++)
+            if (changed & (1u << i))
+                pose[i] += read_delta(bits);
+
+        for (unsigned i = 0; i < 3; i++) {
+            received.position[user * 3 + i] = pose[i];
+            m.users.position[user * 3 + i] =
+                dequantize_position(m.bounds, pose[i], i);
+        }
+        for (unsigned i = 0; i < 4; i++)
+            received.orientation[user * 4 + i] = pose[3 + i];
+        decompress_orientation(
+            join_orientation(pose + 3),
+            m.users.orientation.values.get() + user * 4
+        );
+    }
+    align(bits);
+
+    auto voices = view_voices(m, b);
+    push();
+    return voices;
 }
@@ -3,11 +3,14 @@
 #include <cinttypes>
 #include <memory>
 #include <span>
+#include <array>
 
 #include "../utility/unique_span.h"
 
 struct uuid {
     std::uint64_t values[2];
+
+    bool operator==(const uuid &) const = default;
 };
 
 namespace extensions {
@@ -19,36 +22,265 @@ namespace extensions {
     const uuid avatar {0x99155c895990459c, 0xa0798a1d9b68fe1b};
     const uuid video {0x6e3ac3cdb6a8459c, 0xa2503fc0914477b9};
     const uuid user {0xc7684c34f50e4529, 0xbaf96e45f0c82f2c};
+    // poses may be delta encoded against an acknowledged tick
+    const uuid delta_pose {0x1b9d4f7e2ac34e0f, 0x95e8c3a76b21d054};
 };
 
+// Sent once in each direction right after connecting, before any message. The
+// client lists the extensions that it wants and the server answers with the
+// ones that it will send. Ticks to clients that didn't get voice end after the
+// poses.
 struct initial_message {
     initial_message(unsigned extension_capacity);
 
     std::uint16_t size = 0;
     unique_span<uuid> extensions;
+    // the most bytes of voice per user that the sender accepts
+    std::uint16_t audio_capacity = 0;
+};
+
+// What clients ask for, they accept any size of voice
+initial_message handshake_request(bool voice = true);
+bool has_extension(const initial_message &m, const uuid &extension);
+// throws if there are extension_capacity extensions already
+void add_extension(initial_message &m, const uuid &extension);
+
+// Positions are sent as 16 bit fixed point numbers relative to the origin of
+// the room, which covers 2^(15 - mantissa_bits) meters in each direction. Both
+// sides have to use the same bounds. The origin is in whole meters, so decoded
+// positions quantize to the same values again.
+struct position_bounds {
+    std::int32_t origin[3] {0, 0, 0};
+    unsigned mantissa_bits = 8;
 };
 
+struct message_view;
+
 struct message {
     message() = default;
 
     void reset(unsigned user_capacity, unsigned audio_capacity);
+    // grows to at least user_capacity users and keeps the current ones
+    void reserve(unsigned user_capacity);
     void clear();
-    void append(const message &other);
+    // Appends a single user of other, or all users of a received message.
+    // Both grow the message if they don't fit.
+    void append(const message &other, unsigned user);
+    void append(const message_view &other);
+
+    // The number of the tick on the server. Clients send the number of the
+    // last tick they received instead, to acknowledge it.
+    std::uint32_t tick = 0;
+    // The tick that poses are delta encoded against, or 0 if they are absolute
+    std::uint32_t baseline_tick = 0;
 
     struct {
         std::uint16_t size = 0;
+        // Stable for as long as a user is connected, the server reuses the
+        // ids of users that left. Clients send anything.
+        unique_span<std::uint16_t> id;
         unique_span<float> position;
         unique_span<float> orientation;
         unique_span<std::pair<uint16_t, unique_span<std::uint8_t>>> voice;
     } users;
 
-    unsigned user_capacity, audio_capacity;
+    // not sent, the same for all messages of a room
+    position_bounds bounds;
+    // Not sent either, agreed on in the handshake. Without it, the message
+    // ends after the poses.
+    bool voice = true;
+
+    // audio_capacity is at least the capacity of each user's voice
+    unsigned user_capacity = 0, audio_capacity = 0;
 };
 
-void write(initial_message &m, std::span<std::uint8_t> b);
+// write returns the number of bytes used, which is at most capacity(m)
+std::size_t write(initial_message &m, std::span<std::uint8_t> b);
 void read(initial_message &m, std::span<std::uint8_t> b);
 std::size_t capacity(initial_message &m);
 
-void write(message &m, std::span<std::uint8_t> b);
+// Quantized poses of a message that was sent or received, to delta encode
+// later messages against. Orientations are split into the index and the three
+// components of compress_orientation.
+struct pose_snapshot {
+    std::uint32_t tick = 0;
+    std::uint16_t size = 0;
+    unique_span<std::uint16_t> id;
+    unique_span<std::int16_t> position;
+    unique_span<std::int16_t> orientation;
+};
+
+// The last few snapshots, oldest get overwritten first
+struct pose_history {
+    void reset(unsigned length, unsigned user_capacity);
+    // for messages that are sent, read pushes received ones itself
+    void push(const message &m);
+    const pose_snapshot *find(std::uint32_t tick) const;
+
+    unique_span<pose_snapshot> snapshots;
+    unsigned next = 0;
+    // filled in by read and swapped in once the whole message was read
+    pose_snapshot received;
+};
+
+// Orientations are sent as the three smallest components of the normalized
+// quaternion and the index of the largest one, which is restored from them.
+// The smaller ones are at most 1/sqrt(2), each takes this many bits.
+constexpr unsigned orientation_component_bits = 10;
+static_assert(2 + 3 * orientation_component_bits <= 32);
+
+std::uint32_t compress_orientation(const float *quaternion);
+// the result is q or -q, which is the same rotation
+void decompress_orientation(std::uint32_t compressed, float *quaternion);
+
+enum class wire_encoding {
+    integer,
+    // relative to the message's position bounds
+    position,
+    // compress_orientation
+    smallest_three,
+};
+
+// Wire layout of a message without a baseline, in the order it is written.
+// The header is followed by one array per user field, holding count big-endian
+// integers per user, and then by the voice of each user.
+struct wire_field {
+    const char *name;
+    // bytes per integer and integers per user
+    std::size_t size, count;
+    wire_encoding encoding;
+};
+
+constexpr wire_field message_header_layout[] {
+    {"tick", 4, 1, wire_encoding::integer},
+    {"baseline_tick", 4, 1, wire_encoding::integer},
+    {"users.size", 2, 1, wire_encoding::integer},
+};
+
+constexpr wire_field message_user_layout[] {
+    {"users.id", 2, 1, wire_encoding::integer},
+    {"users.position", 2, 3, wire_encoding::position},
+    {"users.orientation", 4, 1, wire_encoding::smallest_three},
+};
+
+// a size and as many bytes of audio
+constexpr wire_field message_voice_layout {
+    "users.voice", 2, 1, wire_encoding::integer
+};
+
+// of the fields before end, which is also the offset of the field end per user
+template<std::size_t N>
+constexpr std::size_t layout_size(
+    const wire_field (&layout)[N], std::size_t end = N
+) {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < end; i++)
+        size += layout[i].size * layout[i].count;
+    return size;
+}
+
+constexpr std::size_t message_header_size = layout_size(message_header_layout);
+// per user, without the voice
+constexpr std::size_t message_user_size = layout_size(message_user_layout);
+
+static_assert(
+    message_header_size ==
+    sizeof(message::tick) + sizeof(message::baseline_tick) +
+    sizeof(decltype(message::users)::size)
+);
+
+// The voice of each user of a received message, as slices of the buffer that
+// it was received in
+struct voice_view {
+    struct iterator {
+        std::span<const std::uint8_t> operator*() const;
+        iterator &operator++();
+        bool operator==(const iterator &) const = default;
+
+        const std::uint8_t *at;
+    };
+
+    iterator begin() const {
+        return {b.data()};
+    }
+    iterator end() const {
+        return {b.data() + b.size()};
+    }
+
+    // the voice section and nothing after it
+    std::span<const std::uint8_t> b;
+};
+
+// Why a received message can't be read. Parsing untrusted input returns these
+// instead of throwing, so hostile messages are cheap to drop.
+enum class read_error {
+    none,
+    truncated,
+    // more users or longer voices than the reader allows
+    too_large,
+    // message_view only reads absolute messages
+    delta_encoded,
+};
+
+// checked before anything else is read
+struct read_limits {
+    unsigned user_capacity = 0xffff, audio_capacity = 0xffff;
+};
+
+// Reads a received message in place, without copying it. The sizes of all
+// sections are checked once by parse, accessors don't check anything. Only
+// absolute messages can be viewed, delta encoded poses need their baseline.
+struct message_view {
+    message_view() = default;
+    // throws like read
+    message_view(
+        std::span<const std::uint8_t> b, const position_bounds &bounds = {}
+    );
+
+    // doesn't throw, the view is only valid if this returns read_error::none
+    read_error parse(
+        std::span<const std::uint8_t> b, const read_limits &limits = {},
+        const position_bounds &bounds = {}
+    );
+
+    std::uint16_t id(unsigned user) const;
+    std::array<float, 3> position(unsigned user) const;
+    std::array<float, 4> orientation(unsigned user) const;
+
+    std::uint32_t tick = 0, baseline_tick = 0;
+    std::uint16_t size = 0;
+    voice_view voices;
+
+    // the arrays of user fields
+    const std::uint8_t *users = nullptr;
+    position_bounds bounds;
+};
+
+// Like read, but doesn't throw. Lists of more extensions than m has capacity
+// for are too large.
+read_error parse(initial_message &m, std::span<const std::uint8_t> b);
+
+std::size_t write(message &m, std::span<std::uint8_t> b);
 void read(message &m, std::span<std::uint8_t> b);
 std::size_t capacity(message &m);
+// Bytes that the header and a single user take up when written without a
+// baseline. Delta encoded users can take up to delta_user_overhead more.
+std::size_t header_size(const message &m);
+std::size_t user_size(const message &m, unsigned user);
+// in whole bytes per user, which also covers the padding of the last byte
+std::size_t delta_user_overhead();
+
+// Encodes each user's pose as a change mask and deltas against the pose with
+// the same id in the baseline. Unchanged poses at the same index as in the
+// baseline cost two bits.
+std::size_t write(
+    message &m, std::span<std::uint8_t> b, const pose_snapshot &baseline
+);
+// Reads absolute or delta encoded messages. The baseline has to be in history.
+// The poses are pushed to history as they were sent, because orientations that
+// were decompressed can compress differently.
+void read(message &m, std::span<std::uint8_t> b, pose_history &history);
+// Like read, but leaves the voices in b. m's voices are left as they were.
+voice_view read_poses(
+    message &m, std::span<std::uint8_t> b, pose_history &history
+);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cinttypes>
+#include <chrono>
+#include <deque>
+#include <span>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+// How a message is treated while it waits to be written
+enum class outbound_kind {
+    // always written, like the handshake
+    reliable,
+    // overwritten by the next pose, so only the latest one waits
+    pose,
+    // when more than voice_capacity wait, the oldest is dropped
+    voice,
+};
+
+// Messages waiting to be written, oldest first, until the connection fails.
+// Not thread-safe, the websocket locks around it.
+struct outbound_queue {
+    // a few packets of 60 ms, voice that waits longer is too late to be useful
+    static constexpr unsigned voice_capacity = 4;
+
+    struct entry {
+        std::vector<std::uint8_t> buffer;
+        outbound_kind kind = outbound_kind::reliable;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    void push(std::span<const std::uint8_t> message, outbound_kind kind) {
+        if (closed) {
+            dropped_count++;
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        // the front entry can't be changed while it's written
+        auto waiting = entries.begin() + (writing ? 1 : 0);
+        if (
+            kind == outbound_kind::pose && waiting != entries.end() &&
+            entries.back().kind == outbound_kind::pose
+        ) {
+            // keeps the time of the replaced message, which waited longer
+            entries.back().buffer.assign(message.begin(), message.end());
+            coalesced_count++;
+            return;
+        }
+        if (kind == outbound_kind::voice) {
+            auto is_voice = [](const entry &e) {
+                return e.kind == outbound_kind::voice;
+            };
+            auto voice_count = std::count_if(waiting, entries.end(), is_voice);
+            if (voice_count >= std::ptrdiff_t(voice_capacity)) {
+                entries.erase(std::find_if(waiting, entries.end(), is_voice));
+                dropped_count++;
+            }
+        }
+        entries.push_back({
+            std::vector<std::uint8_t>(message.begin(), message.end()), kind, now
+        });
+    }
+
+    // whether there is a message that isn't being written yet
+    bool ready() const {
+        return !closed && !writing && !entries.empty();
+    }
+
+    // The oldest message, which can't be replaced anymore. It stays valid
+    // until finish.
+    std::span<const std::uint8_t> start() {
+        writing = true;
+        auto &front = entries.front();
+        std::uint64_t latency =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - front.queued
+            ).count();
+        latency_total += latency;
+        latency_maximum = std::max<std::uint64_t>(latency_maximum, latency);
+        written_count++;
+        return front.buffer;
+    }
+
+    void finish() {
+        entries.pop_front();
+        writing = false;
+    }
+
+    // After a write failed nothing more is written, the waiting messages and
+    // later ones are dropped
+    void close() {
+        dropped_count += entries.size();
+        entries.clear();
+        writing = false;
+        closed = true;
+    }
+
+    std::deque<entry> entries;
+    // the front entry is being written
+    bool writing = false;
+    bool closed = false;
+
+    // Statistics. The time from push until start is in microseconds. They are
+    // atomic so they can be read without the lock.
+    std::atomic_uint64_t
+        written_count = 0, coalesced_count = 0, dropped_count = 0,
+        latency_total = 0, latency_maximum = 0;
+};
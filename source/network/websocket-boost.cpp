@@ -19,21 +19,32 @@ struct url_view
 };
 
 struct websocket::data {
-    data(client &c) : c(c) {}
+    data(client &c, websocket &s) : c(c), s(s) {}
     virtual ~data() = default;
     virtual void read(std::shared_ptr<std::promise<void>> promise) = 0;
-    virtual void try_write_message(websocket &s) = 0;
-    std::atomic_bool write_completed = false;
+    virtual void write(std::span<const std::uint8_t> message) = 0;
+    // with the outbound mutex locked
+    void write_next();
+    // called on the event loop's thread
+    void opened();
+    void written();
+    // a write failed, the outbound queue is closed
+    void failed();
     client &c;
+    websocket &s;
+    // guarded by the outbound mutex
+    bool open = false;
     std::future<void> completion;
     std::weak_ptr<std::promise<void>> completion_promise;
 };
 
 struct insecure_websocket : public websocket::data {
     void read(std::shared_ptr<std::promise<void>> promise) override;
-    void try_write_message(websocket& s) override;
+    void write(std::span<const std::uint8_t> message) override;
 
-    insecure_websocket(client &c, event_loop &loop, url_view url);
+    insecure_websocket(
+        client &c, websocket &s, event_loop &loop, url_view url
+    );
     ~insecure_websocket(); // TODO: can't destroy while requests are running
     boost::beast::websocket::stream<boost::asio::ip::tcp::socket> stream;
     boost::beast::flat_buffer buffer;
@@ -42,9 +53,9 @@ struct insecure_websocket : public websocket::data {
 
 struct secure_websocket : public websocket::data {
     void read(std::shared_ptr<std::promise<void>> promise) override;
-    void try_write_message(websocket& s) override;
+    void write(std::span<const std::uint8_t> message) override;
 
-    secure_websocket(client& c, event_loop& loop, url_view url);
+    secure_websocket(client& c, websocket &s, event_loop& loop, url_view url);
     ~secure_websocket(); // TODO: can't destroy while requests are running
     boost::asio::ssl::context ssl_context;
     boost::beast::websocket::stream<
@@ -99,9 +110,9 @@ websocket::websocket(
     if (url.port.empty())
         url.port = "443";
     if (url.scheme == "ws")
-        d.reset(new insecure_websocket(c, loop, url));
+        d.reset(new insecure_websocket(c, *this, loop, url));
     else if (url.scheme == "wss")
-        d.reset(new secure_websocket(c, loop, url));
+        d.reset(new secure_websocket(c, *this, loop, url));
     else
         throw std::runtime_error(
             "Unsupported url " + std::string(url_string)
@@ -113,21 +124,40 @@ websocket::~websocket() {
     // translation unit
 }
 
-bool websocket::try_write_message(std::span<std::uint8_t> buffer) {
-    if (d->write_completed) {
-        next_message = buffer;
-        d->write_completed = false;
-        // need to post because stream is not thread safe
-        loop.d->context.post([this](){
-            d->try_write_message(*this);
-        });
-        return true;
-    }
-    return false;
+void websocket::write_message(
+    std::span<const std::uint8_t> buffer, outbound_kind kind
+) {
+    std::scoped_lock lock(outbound_mutex);
+    outbound.push(buffer, kind);
+    if (d->open && outbound.ready())
+        d->write_next();
+}
+
+void websocket::data::write_next() {
+    auto message = s.outbound.start();
+    // need to post because stream is not thread safe
+    s.loop.d->context.post([this, message](){
+        write(message);
+    });
+}
+
+void websocket::data::opened() {
+    std::scoped_lock lock(s.outbound_mutex);
+    open = true;
+    if (s.outbound.ready())
+        write_next();
+}
+
+void websocket::data::written() {
+    std::scoped_lock lock(s.outbound_mutex);
+    s.outbound.finish();
+    if (s.outbound.ready())
+        write_next();
 }
 
-bool websocket::is_write_completed() {
-    return d->write_completed;
+void websocket::data::failed() {
+    std::scoped_lock lock(s.outbound_mutex);
+    s.outbound.close();
 }
 
 url_view::url_view(std::string_view url) {
@@ -169,21 +199,25 @@ void insecure_websocket::read(std::shared_ptr<std::promise<void>> promise) {
     );
 }
 
-void insecure_websocket::try_write_message(websocket& s) {
+void insecure_websocket::write(std::span<const std::uint8_t> message) {
     auto promise = completion_promise.lock();
     stream.async_write(
-        boost::asio::buffer(s.next_message.data(), s.next_message.size()),
-        [&s, promise](boost::beast::error_code error, size_t) {
-            if (check(error)) return;
-            s.d->write_completed = true;
+        boost::asio::buffer(message.data(), message.size()),
+        [this, promise](boost::beast::error_code error, size_t) {
+            if (check(error)) {
+                // otherwise the queue would wait for this write forever
+                failed();
+                return;
+            }
+            written();
         }
     );
 }
 
 insecure_websocket::insecure_websocket(
-    client& c, event_loop& loop, url_view url
+    client& c, websocket &s, event_loop& loop, url_view url
 ) :
-    websocket::data(c), stream(loop.d->context), context(loop.d->context)
+    websocket::data(c, s), stream(loop.d->context), context(loop.d->context)
 {
     auto promise = std::make_shared<std::promise<void>>();
     completion_promise = promise;
@@ -212,7 +246,7 @@ insecure_websocket::insecure_websocket(
                             [this, promise] (boost::beast::error_code error) {
                                 if (check(error)) return;
                                 // allow writing now
-                                write_completed = true;
+                                opened();
                                 read(promise);
                             }
                         );
@@ -248,21 +282,26 @@ void secure_websocket::read(std::shared_ptr<std::promise<void>> promise) {
     );
 }
 
-void secure_websocket::try_write_message(websocket& s) {
+void secure_websocket::write(std::span<const std::uint8_t> message) {
     auto promise = completion_promise.lock();
     stream.async_write(
-        boost::asio::buffer(s.next_message.data(), s.next_message.size()),
-        [&s, promise] (boost::beast::error_code error, size_t) {
-            if (check(error)) return;
-            s.d->write_completed = true;
+        boost::asio::buffer(message.data(), message.size()),
+        [this, promise] (boost::beast::error_code error, size_t) {
+            if (check(error)) {
+                // otherwise the queue would wait for this write forever
+                failed();
+                return;
+            }
+            written();
         }
     );
 }
 
 secure_websocket::secure_websocket(
-    client& c, event_loop& loop, url_view url
+    client& c, websocket &s, event_loop& loop, url_view url
 ) :
-    websocket::data(c), ssl_context{boost::asio::ssl::context::tlsv12_client},
+    websocket::data(c, s),
+    ssl_context{boost::asio::ssl::context::tlsv12_client},
     stream(loop.d->context, ssl_context), context(loop.d->context)
 {
     auto promise = std::make_shared<std::promise<void>>();
@@ -307,7 +346,7 @@ secure_websocket::secure_websocket(
                                     (boost::beast::error_code error) {
                                         if (check(error)) return;
                                         // allow writing now
-                                        write_completed = true;
+                                        opened();
                                         read(promise);
                                     }
                                 );
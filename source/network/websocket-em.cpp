@@ -14,6 +14,24 @@ struct websocket::data {
     bool open = false;
 };
 
+// Hands queued messages to the browser, but only once it sent the earlier ones,
+// so that poses can be replaced while they wait. With the outbound mutex
+// locked.
+void flush(websocket &s) {
+    while (s.d->open && s.outbound.ready()) {
+        size_t buffered = 0;
+        emscripten_websocket_get_buffered_amount(s.d->websocket, &buffered);
+        if (buffered > 0)
+            break;
+        auto message = s.outbound.start();
+        emscripten_websocket_send_binary(
+            s.d->websocket, const_cast<std::uint8_t*>(message.data()),
+            message.size()
+        );
+        s.outbound.finish();
+    }
+}
+
 EM_BOOL message_callback(
     int eventType, const EmscriptenWebSocketMessageEvent *websocketEvent, 
     void* userData
@@ -29,7 +47,10 @@ EM_BOOL open_callback(
     int eventType, const EmscriptenWebSocketOpenEvent *websocketEvent, 
     void* userData
 ) {
-    ((websocket*)userData)->d->open = true;
+    auto &s = *(websocket*)userData;
+    std::scoped_lock lock(s.outbound_mutex);
+    s.d->open = true;
+    flush(s);
     return EM_TRUE;
 }
 
@@ -37,7 +58,12 @@ EM_BOOL close_callback(
     int eventType, const EmscriptenWebSocketCloseEvent *websocketEvent, 
     void* userData
 ) {
-    set_disconnected(((websocket*)userData)->d->c);
+    auto &s = *(websocket*)userData;
+    {
+        std::scoped_lock lock(s.outbound_mutex);
+        s.outbound.close();
+    }
+    set_disconnected(s.d->c);
     return EM_TRUE;
 }
 
@@ -74,16 +100,10 @@ websocket::~websocket() {
     emscripten_websocket_set_onclose_callback(d->websocket, this, nullptr);
 }
 
-bool websocket::try_write_message(std::span<std::uint8_t> buffer) {
-    if (d->open) {
-        emscripten_websocket_send_binary(
-            d->websocket, buffer.data(), buffer.size()
-        );
-        return true;
-    }
-    return false;
-}
-
-bool websocket::is_write_completed() {
-    return true;
+void websocket::write_message(
+    std::span<const std::uint8_t> buffer, outbound_kind kind
+) {
+    std::scoped_lock lock(outbound_mutex);
+    outbound.push(buffer, kind);
+    flush(*this);
 }
@@ -5,6 +5,9 @@
 #include <span>
 #include <string_view>
 #include <atomic>
+#include <mutex>
+
+#include "outbound_queue.h"
 
 struct client;
 
@@ -23,12 +26,17 @@ struct websocket {
     websocket(client& client, event_loop& loop, std::string_view url_string);
     ~websocket();
 
-    // buffer needs to stay valid until is_write_completed returns true
-    bool try_write_message(std::span<std::uint8_t> buffer);
-    bool is_write_completed();
+    // Copies the message into the outbound queue, it's written once the
+    // connection is open and the messages before it were written. See
+    // outbound_kind for which messages may be replaced or dropped.
+    void write_message(
+        std::span<const std::uint8_t> buffer, outbound_kind kind
+    );
 
     event_loop& loop;
-    std::unique_ptr<data> d;
+    // before d, which may still use them until it's destroyed
+    std::mutex outbound_mutex;
+    outbound_queue outbound;
 
-    std::span<std::uint8_t> next_message;
+    std::unique_ptr<data> d;
 };
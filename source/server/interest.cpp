@@ -0,0 +1,178 @@
+#include "interest.h"
+
+#include <algorithm>
+#include <cmath>
+
+float interest_radius = 0;
+unsigned far_user_capacity = 4;
+unsigned message_byte_budget = 0;
+
+// priority gained per tick is divided by 1 + distance / distance scale
+const float priority_distance_scale = 10;
+// and multiplied by 1 + speed * speed weight + voice weight if speaking
+const float priority_speed_weight = 1, priority_voice_weight = 4;
+
+glm::vec3 user_position(const message &room, unsigned user) {
+    auto position = room.users.position.begin() + user * 3;
+    return {position[0], position[1], position[2]};
+}
+
+std::uint64_t cell_key(std::int64_t x, std::int64_t y, std::int64_t z) {
+    // 21 bits per axis, wrapping around
+    auto mask = (1ull << 21) - 1;
+    return
+        (std::uint64_t(x) & mask) |
+        (std::uint64_t(y) & mask) << 21 |
+        (std::uint64_t(z) & mask) << 42;
+}
+
+glm::vec3 cell_of(glm::vec3 position, float cell_size) {
+    return glm::floor(position / cell_size);
+}
+
+void spatial_hash::build(const message &room, float cell_size) {
+    this->cell_size = cell_size;
+
+    keys.resize(room.users.size);
+    users.resize(room.users.size);
+    for (auto i = 0u; i < room.users.size; i++) {
+        auto cell = cell_of(user_position(room, i), cell_size);
+        keys[i] = cell_key(cell.x, cell.y, cell.z);
+        users[i] = i;
+    }
+    std::sort(users.begin(), users.end(), [this](auto a, auto b) {
+        return keys[a] < keys[b];
+    });
+
+    cells.clear();
+    for (std::uint32_t begin = 0; begin < users.size();) {
+        auto key = keys[users[begin]];
+        auto end = begin + 1;
+        while (end < users.size() && keys[users[end]] == key)
+            end++;
+        cells[key] = {begin, end};
+        begin = end;
+    }
+}
+
+void spatial_hash::query(
+    const message &room, glm::vec3 position, float radius,
+    std::vector<std::uint32_t> &result
+) const {
+    auto cell = cell_of(position, cell_size);
+    int reach = int(std::ceil(radius / cell_size));
+    for (int z = -reach; z <= reach; z++) {
+        for (int y = -reach; y <= reach; y++) {
+            for (int x = -reach; x <= reach; x++) {
+                auto range = cells.find(cell_key(
+                    std::int64_t(cell.x) + x, std::int64_t(cell.y) + y,
+                    std::int64_t(cell.z) + z
+                ));
+                if (range == cells.end())
+                    continue;
+                for (
+                    auto i = range->second.first; i < range->second.second; i++
+                ) {
+                    auto offset = user_position(room, users[i]) - position;
+                    if (glm::dot(offset, offset) <= radius * radius)
+                        result.push_back(users[i]);
+                }
+            }
+        }
+    }
+}
+
+void spatial_hash::select(
+    const message &room, int recipient, std::uint32_t tick, message &m
+) {
+    m.clear();
+    glm::vec3 center =
+        recipient >= 0 ? user_position(room, recipient) : glm::vec3(0, 0, 0);
+    auto distance = [&](std::uint32_t user) {
+        auto offset = user_position(room, user) - center;
+        return glm::dot(offset, offset);
+    };
+
+    near.clear();
+    query(room, center, interest_radius, near);
+
+    // nearest first, in case they don't all fit
+    if (near.size() > m.user_capacity) {
+        std::nth_element(
+            near.begin(), near.begin() + m.user_capacity, near.end(),
+            [&](auto a, auto b) { return distance(a) < distance(b); }
+        );
+        near.resize(m.user_capacity);
+    }
+    for (auto user : near)
+        m.append(room, user);
+
+    // farther users take turns
+    auto far = std::min(far_user_capacity, m.user_capacity - m.users.size);
+    if (room.users.size == 0)
+        return;
+    auto start = (tick * far_user_capacity) % room.users.size;
+    for (auto i = 0u; i < room.users.size && far > 0; i++) {
+        auto user = (start + i) % room.users.size;
+        if (distance(user) <= interest_radius * interest_radius)
+            continue;
+        m.append(room, user);
+        far--;
+    }
+}
+
+void priority_accumulator::select(
+    const message &room, const std::vector<room_user> &users, int recipient,
+    std::size_t budget, bool delta, message &m
+) {
+    m.clear();
+    glm::vec3 center =
+        recipient >= 0 ? user_position(room, recipient) : glm::vec3(0, 0, 0);
+
+    candidates.clear();
+    for (auto user = 0u; user < room.users.size; user++) {
+        auto id = users[user].id;
+        // ids are reused, a new user inherits the priority of the last one
+        // with its id, so it shows up soon
+        if (id >= priority.size())
+            priority.resize(id + 1, 0);
+        auto distance = glm::distance(user_position(room, user), center);
+        bool speaking = room.users.voice.values[user].first > 0;
+        priority[id] +=
+            (
+                1 + users[user].speed * priority_speed_weight +
+                (speaking ? priority_voice_weight : 0)
+            ) / (1 + distance / priority_distance_scale);
+        candidates.push_back(user);
+    }
+
+    // Candidates are taken in order of priority until m is full, so only
+    // those that are taken need an order. A heap gives them one by one.
+    auto lower_priority = [&](auto a, auto b) {
+        return priority[users[a].id] < priority[users[b].id];
+    };
+    std::make_heap(candidates.begin(), candidates.end(), lower_priority);
+
+    auto overhead = delta ? delta_user_overhead() : 0;
+    // of a user without voice, nothing smaller fits once this doesn't
+    auto smallest = overhead + message_user_size +
+        (m.voice ? message_voice_layout.size : 0);
+    auto size = header_size(m);
+    auto end = candidates.end();
+    while (
+        end != candidates.begin() && m.users.size < m.user_capacity &&
+        size + smallest <= budget
+    ) {
+        std::pop_heap(candidates.begin(), end, lower_priority);
+        auto user = *--end;
+        // A user that is speaking may not fit anymore, but one that isn't can.
+        // Voice only counts if m is sent with it.
+        auto added = overhead +
+            (m.voice ? user_size(room, user) : message_user_size);
+        if (size + added > budget)
+            continue;
+        size += added;
+        m.append(room, user);
+        priority[users[user].id] = 0;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cinttypes>
+
+#include <glm/glm.hpp>
+
+#include "../network/network_message.h"
+
+// Users within this distance of a recipient are sent to it first. 0 sends the
+// first users of the room to everyone.
+extern float interest_radius;
+// Number of users outside of the radius that are sent anyway, so that far
+// users still show up every few ticks. Farther users take turns.
+extern unsigned far_user_capacity;
+// Maximum number of bytes per message to each client. Users are then picked
+// by priority instead of by distance. 0 disables the budget.
+extern unsigned message_byte_budget;
+
+glm::vec3 user_position(const message &room, unsigned user);
+
+// what the tick knows about a user in the room besides its pose
+struct room_user {
+    std::uint16_t id;
+    // in m/s, since the last tick
+    float speed;
+};
+
+/**
+ * @brief Uniform grid over the positions of all users in the room, with cells
+ * the size of the interest radius. Used to assemble a message per recipient.
+ */
+struct spatial_hash {
+    void build(const message &room, float cell_size);
+
+    // appends the indices of all users within radius of position to result
+    void query(
+        const message &room, glm::vec3 position, float radius,
+        std::vector<std::uint32_t> &result
+    ) const;
+
+    // Fills m with the users in room that are relevant to the recipient, as
+    // many as fit. The recipient is an index into room or -1.
+    void select(
+        const message &room, int recipient, std::uint32_t tick, message &m
+    );
+
+    float cell_size = 1;
+    // user indices, sorted by cell
+    std::vector<std::uint32_t> users;
+    // range of users per cell
+    std::unordered_map<
+        std::uint64_t, std::pair<std::uint32_t, std::uint32_t>
+    > cells;
+
+    std::vector<std::uint32_t> near;
+    std::vector<std::uint64_t> keys;
+};
+
+/**
+ * @brief Priorities of all users in the room from the view of one recipient.
+ * Every tick each user gains priority, faster when near, moving or speaking.
+ * The users with the highest priority are sent until the byte budget is used
+ * up and start over at zero, so far or idle users are updated less often
+ * instead of not at all.
+ */
+struct priority_accumulator {
+    // Users holds an entry for every user in room. With delta, m is going to
+    // be delta encoded and each user is counted at its largest delta size.
+    void select(
+        const message &room, const std::vector<room_user> &users,
+        int recipient, std::size_t budget, bool delta, message &m
+    );
+
+    // by user id
+    std::vector<float> priority;
+    std::vector<std::uint32_t> candidates;
+};
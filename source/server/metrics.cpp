@@ -0,0 +1,152 @@
+#include "metrics.h"
+
+#include <cstdio>
+#include <vector>
+
+#include "server.h"
+
+void duration_histogram::observe(std::chrono::microseconds duration) {
+    std::uint64_t value = duration.count();
+    auto bucket = 0u;
+    while (
+        bucket < tick_duration_bounds.size() &&
+        value > tick_duration_bounds[bucket]
+    )
+        bucket++;
+    counts[bucket]++;
+    total += value;
+}
+
+template<class... A>
+void print(std::string &out, const char *format, A... arguments) {
+    char line[256];
+    snprintf(line, sizeof(line), format, arguments...);
+    out += line;
+}
+
+void print_header(
+    std::string &out, const char *name, const char *type, const char *help
+) {
+    print(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void print_counter(
+    std::string &out, const char *name, const char *help, std::uint64_t value
+) {
+    print_header(out, name, "counter", help);
+    print(out, "%s %llu\n", name, (long long unsigned)value);
+}
+
+std::string metrics(server_t &server) {
+    std::string out;
+
+    print_counter(
+        out, "hello_ticks_total", "Ticks that were sent to all sessions.",
+        server.tick_count
+    );
+    print_counter(
+        out, "hello_skipped_ticks_total",
+        "Ticks that were skipped because the previous ones took too long.",
+        server.skipped_tick_count
+    );
+
+    const char *duration = "hello_tick_duration_seconds";
+    print_header(
+        out, duration, "histogram",
+        "Time from the start of a tick until the last session sent or "
+        "dropped it."
+    );
+    std::uint64_t cumulative = 0;
+    for (auto i = 0u; i < tick_duration_bounds.size(); i++) {
+        cumulative += server.tick_durations.counts[i];
+        print(
+            out, "%s_bucket{le=\"%g\"} %llu\n", duration,
+            tick_duration_bounds[i] / 1e6, (long long unsigned)cumulative
+        );
+    }
+    // from the same loads as the buckets, a separate count could be off from
+    // them by the ticks that completed meanwhile
+    cumulative += server.tick_durations.counts.back();
+    print(
+        out, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n",
+        duration, (long long unsigned)cumulative,
+        duration, server.tick_durations.total / 1e6,
+        duration, (long long unsigned)cumulative
+    );
+
+    print_counter(
+        out, "hello_received_bytes_total",
+        "Bytes of messages received from clients.", server.received_byte_count
+    );
+    print_counter(
+        out, "hello_rejected_messages_total",
+        "Messages from clients that were malformed or too large.",
+        server.rejected_message_count
+    );
+    print_counter(
+        out, "hello_sent_bytes_total", "Bytes of ticks sent to clients.",
+        server.sent_byte_count
+    );
+    print_counter(
+        out, "hello_sent_frames_total", "Ticks sent to clients.",
+        server.sent_frame_count
+    );
+    print_counter(
+        out, "hello_dropped_frames_total",
+        "Ticks dropped because a client was too slow to receive them.",
+        server.dropped_frame_count
+    );
+
+    // the queues are only sampled when scraped
+    std::vector<std::uint64_t> queue_depths(outbound_queue_capacity + 1);
+    std::uint64_t session_count = 0, queued_total = 0;
+    {
+        std::scoped_lock lock(server.sessions_mutex);
+        for (auto &session : server.sessions) {
+            auto depth = std::min<unsigned>(
+                session->queue_depth, outbound_queue_capacity
+            );
+            queue_depths[depth]++;
+            queued_total += depth;
+            session_count++;
+        }
+    }
+
+    print_header(
+        out, "hello_sessions", "gauge", "Connected websocket sessions."
+    );
+    print(out, "hello_sessions %llu\n", (long long unsigned)session_count);
+
+    const char *queue = "hello_session_queue_depth";
+    print_header(
+        out, queue, "histogram",
+        "Ticks waiting to be sent, per session, when scraped."
+    );
+    cumulative = 0;
+    for (auto depth = 0u; depth < queue_depths.size(); depth++) {
+        cumulative += queue_depths[depth];
+        print(
+            out, "%s_bucket{le=\"%u\"} %llu\n", queue, depth,
+            (long long unsigned)cumulative
+        );
+    }
+    print(
+        out, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %llu\n%s_count %llu\n",
+        queue, (long long unsigned)session_count,
+        queue, (long long unsigned)queued_total,
+        queue, (long long unsigned)session_count
+    );
+
+    print_header(out, "hello_coroutines", "gauge", "Running coroutines.");
+    print(
+        out,
+        "hello_coroutines{name=\"accept\"} %lld\n"
+        "hello_coroutines{name=\"serve\"} %lld\n"
+        "hello_coroutines{name=\"read\"} %lld\n",
+        (long long)server.accept_coroutine_count.load(),
+        (long long)server.serve_coroutine_count.load(),
+        (long long)server.read_coroutine_count.load()
+    );
+
+    return out;
+}
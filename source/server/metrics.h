@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include <cinttypes>
+
+struct server_t;
+
+// upper bounds of the buckets of tick durations, in microseconds
+const std::array<std::uint64_t, 10> tick_duration_bounds{
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+
+/**
+ * @brief Number of durations per bucket, like a Prometheus histogram. Can be
+ * updated from any thread.
+ */
+struct duration_histogram {
+    void observe(std::chrono::microseconds duration);
+
+    // the last bucket counts durations above all bounds
+    std::array<std::atomic_uint64_t, tick_duration_bounds.size() + 1> counts{};
+    std::atomic_uint64_t total = 0;
+};
+
+// Counts running coroutines of one kind while in scope
+struct coroutine_scope {
+    coroutine_scope(std::atomic_int64_t &count) : count(count) {
+        count++;
+    }
+    ~coroutine_scope() {
+        count--;
+    }
+    std::atomic_int64_t &count;
+};
+
+// The server's state in the Prometheus text format, served at /metrics
+std::string metrics(server_t &server);
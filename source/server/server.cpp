@@ -0,0 +1,759 @@
+#include "server.h"
+
+#include <algorithm>
+#include <coroutine>
+#include <thread>
+#include <memory>
+#include <optional>
+
+#include <boost/lexical_cast.hpp>
+
+#include "../utility/serialization.h"
+
+std::chrono::milliseconds tick_time{50};
+
+unsigned message_user_capacity = 16;
+unsigned message_audio_capacity = 200;
+unsigned outbound_queue_capacity = 4;
+bool delta_encoding = false;
+unsigned pose_history_length = 16;
+bool preframed_writes = false;
+// of messages from clients that are read frame by frame, the handshake is the
+// largest
+const std::size_t frame_message_max = 0x10000;
+
+const uuid server_extensions[4] {
+    extensions::pose, extensions::user, extensions::voice,
+    extensions::delta_pose,
+};
+
+server_t* server;
+
+std::span<std::uint8_t> to_span(boost::beast::flat_buffer &buffer) {
+    return {
+        reinterpret_cast<std::uint8_t*>(buffer.data().data()), buffer.size()
+    };
+}
+
+server_t::server_t(boost::asio::io_context& context, unsigned short port) :
+    context(context),
+    acceptor(context, boost::asio::ip::tcp::endpoint{{}, port}),
+    tick_strand(boost::asio::make_strand(context)),
+    tick_timer(tick_strand, std::chrono::steady_clock::now())
+{
+    m.reset(message_user_capacity, message_audio_capacity);
+    room.reset(message_user_capacity, message_audio_capacity);
+}
+
+// The size of the voice of a received message's single user, which the tick
+// sets to 0 once it sent the voice
+std::span<std::uint8_t> voice_size(boost::beast::flat_buffer &received) {
+    return to_span(received).subspan(
+        message_header_size + message_user_size, message_voice_layout.size
+    );
+}
+
+bool pending_voice(boost::beast::flat_buffer &received) {
+    if (received.size() == 0)
+        return false;
+    auto size = voice_size(received);
+    return std::any_of(size.begin(), size.end(), [](auto b) { return b != 0; });
+}
+
+// header of an unfragmented, unmasked websocket frame
+void build_header(tick_frame &frame, std::uint8_t opcode) {
+    auto size = frame.buffer.size();
+    frame.header[0] = 0x80 | opcode;
+    if (size < 126) {
+        frame.header[1] = size;
+        frame.header_size = 2;
+    } else if (size < 0x10000) {
+        frame.header[1] = 126;
+        frame.header_size = 4;
+    } else {
+        frame.header[1] = 127;
+        frame.header_size = 10;
+    }
+    // the extended length is big-endian
+    for (auto i = 2u; i < frame.header_size; i++)
+        frame.header[i] = size >> (8 * (frame.header_size - i - 1));
+}
+
+namespace opcode {
+    const std::uint8_t
+        continuation = 0x0, text = 0x1, binary = 0x2, close = 0x8, ping = 0x9,
+        pong = 0xa;
+}
+
+// a frame that isn't part of a tick, e.g. a pong
+std::shared_ptr<const tick_frame> make_frame(
+    std::uint8_t opcode, std::span<const std::uint8_t> payload
+) {
+    auto frame = std::make_shared<tick_frame>();
+    frame->buffer.assign(payload.begin(), payload.end());
+    build_header(*frame, opcode);
+    return frame;
+}
+
+void enqueue(
+    boost::intrusive_ptr<session> session,
+    std::shared_ptr<const tick_frame> frame
+);
+
+// reads until session.frames holds at least size bytes
+boost::asio::awaitable<void> fill(
+    session &session, std::size_t size, boost::system::error_code &error
+) {
+    auto completion_token =
+        boost::asio::redirect_error(boost::asio::use_awaitable, error);
+    while (session.frames.size() < size) {
+        auto read = co_await session.stream.next_layer().async_read_some(
+            session.frames.prepare(
+                std::max<std::size_t>(size - session.frames.size(), 4096)
+            ),
+            completion_token
+        );
+        if (error)
+            co_return;
+        session.frames.commit(read);
+    }
+}
+
+// Reads frames until a whole data message is in session->buffer and returns
+// its size, for sessions with preframed writes. Pings are answered and closes
+// echoed through the outbound queue, in order with the ticks. Protocol errors
+// are answered with a close frame and end the read like a close does.
+boost::asio::awaitable<std::size_t> read_frames(
+    boost::intrusive_ptr<session> session, boost::system::error_code &error
+) {
+    namespace websocket = boost::beast::websocket;
+    auto fail = [&](websocket::error code) {
+        // status 1002, protocol error
+        const std::uint8_t status[] = {0x03, 0xea};
+        enqueue(session, make_frame(opcode::close, status));
+        error = code;
+    };
+
+    while (true) {
+        co_await fill(*session, 2, error);
+        if (error)
+            co_return 0;
+        auto frame = to_span(session->frames);
+        bool final = frame[0] & 0x80;
+        std::uint8_t code = frame[0] & 0x0f;
+        std::uint64_t length = frame[1] & 0x7f;
+        // the masking key comes last, clients have to mask every frame
+        std::size_t header_size =
+            2 + (length == 126 ? 2 : length == 127 ? 8 : 0) + 4;
+        if (frame[0] & 0x70) {
+            fail(websocket::error::bad_reserved_bits);
+            co_return 0;
+        }
+        if (!(frame[1] & 0x80)) {
+            fail(websocket::error::bad_unmasked_frame);
+            co_return 0;
+        }
+
+        co_await fill(*session, header_size, error);
+        if (error)
+            co_return 0;
+        frame = to_span(session->frames);
+        if (length >= 126) {
+            length = 0;
+            for (auto i = 2u; i < header_size - 4; i++)
+                length = length << 8 | frame[i];
+        }
+        bool control = code & 0x8;
+        if (control && (!final || length > 125)) {
+            fail(websocket::error::bad_control_fragment);
+            co_return 0;
+        }
+        if (!control && length > frame_message_max - session->buffer.size()) {
+            fail(websocket::error::message_too_big);
+            co_return 0;
+        }
+
+        co_await fill(*session, header_size + length, error);
+        if (error)
+            co_return 0;
+        frame = to_span(session->frames);
+        auto mask = frame.subspan(header_size - 4, 4);
+        auto payload = frame.subspan(header_size, length);
+        for (std::size_t i = 0; i < payload.size(); i++)
+            payload[i] ^= mask[i % 4];
+
+        bool received = false;
+        if (
+            code == opcode::continuation || code == opcode::text ||
+            code == opcode::binary
+        ) {
+            // continuations only follow the start of a fragmented message
+            if ((code == opcode::continuation) != session->fragmented) {
+                fail(websocket::error::bad_continuation);
+                co_return 0;
+            }
+            session->buffer.commit(boost::asio::buffer_copy(
+                session->buffer.prepare(payload.size()),
+                boost::asio::buffer(payload.data(), payload.size())
+            ));
+            session->fragmented = !final;
+            received = final;
+        } else if (code == opcode::ping) {
+            enqueue(session, make_frame(opcode::pong, payload));
+        } else if (code == opcode::close) {
+            // echoes the status code, if there is one
+            enqueue(
+                session,
+                make_frame(
+                    opcode::close, payload.first(payload.size() < 2 ? 0 : 2)
+                )
+            );
+            error = websocket::error::closed;
+            co_return 0;
+        } else if (code != opcode::pong) {
+            fail(websocket::error::bad_opcode);
+            co_return 0;
+        }
+        session->frames.consume(header_size + length);
+        if (received)
+            co_return session->buffer.size();
+    }
+}
+
+// reads the next message into session->buffer
+boost::asio::awaitable<std::size_t> receive(
+    boost::intrusive_ptr<session> session, boost::system::error_code &error
+) {
+    if (preframed_writes)
+        co_return co_await read_frames(session, error);
+    co_return co_await session->stream.async_read(
+        session->buffer,
+        boost::asio::redirect_error(boost::asio::use_awaitable, error)
+    );
+}
+
+boost::asio::awaitable<void> read(boost::intrusive_ptr<session> session) {
+    coroutine_scope scope(server->read_coroutine_count);
+    boost::system::error_code error;
+
+    while (true) {
+        size_t size = co_await receive(session, error);
+
+        if (error) {
+            printf("Error %s.\n", error.message().c_str());
+            co_return;
+        }
+
+        server->received_byte_count += size;
+        if (size > 0) {
+            // clients send their own user only, anything else is dropped
+            message_view view;
+            auto result = view.parse(
+                to_span(session->buffer), {1, message_audio_capacity},
+                server->room.bounds
+            );
+            if (result != read_error::none || view.size != 1) {
+                server->rejected_message_count++;
+                session->buffer.consume(session->buffer.size());
+                continue;
+            }
+            std::scoped_lock lock(session->mutex);
+            if (
+                (*view.voices.begin()).empty() &&
+                pending_voice(session->received)
+            ) {
+                // Clients send poses more often than voice. A pose without
+                // voice only replaces the pose of a message whose voice
+                // wasn't sent by a tick yet.
+                std::copy_n(
+                    to_span(session->buffer).begin(),
+                    message_header_size + message_user_size,
+                    to_span(session->received).begin()
+                );
+            } else {
+                std::swap(session->buffer, session->received);
+            }
+        }
+
+        session->buffer.consume(session->buffer.size());
+    }
+}
+
+// Answers with the extensions of the client's handshake that the server sends.
+// Voice is only sent to clients that accept every voice the server accepts.
+initial_message negotiate(session &session, const initial_message &request) {
+    initial_message response(std::size(server_extensions));
+    for (auto &extension : server_extensions) {
+        if (
+            !has_extension(request, extension) ||
+            (extension == extensions::delta_pose && !delta_encoding) ||
+            (
+                extension == extensions::voice &&
+                request.audio_capacity < message_audio_capacity
+            )
+        )
+            continue;
+        add_extension(response, extension);
+    }
+    response.audio_capacity = message_audio_capacity;
+    session.voice = has_extension(response, extensions::voice);
+    session.delta = has_extension(response, extensions::delta_pose);
+    return response;
+}
+
+// answers plain HTTP requests, only /metrics exists
+boost::asio::awaitable<void> respond(boost::intrusive_ptr<session> session) {
+    namespace http = boost::beast::http;
+    boost::system::error_code error;
+    auto completion_token =
+        boost::asio::redirect_error(boost::asio::use_awaitable, error);
+
+    http::response<http::string_body> response;
+    response.version(session->request.version());
+    response.keep_alive(false);
+    if (
+        session->request.method() == http::verb::get &&
+        session->request.target() == "/metrics"
+    ) {
+        response.result(http::status::ok);
+        response.set(http::field::content_type, "text/plain; version=0.0.4");
+        response.body() = metrics(*server);
+    } else {
+        response.result(http::status::not_found);
+    }
+    response.prepare_payload();
+
+    co_await http::async_write(
+        session->stream.next_layer(), response, completion_token
+    );
+    session->stream.next_layer().shutdown(
+        boost::asio::ip::tcp::socket::shutdown_send, error
+    );
+}
+
+boost::asio::awaitable<void> serve(boost::intrusive_ptr<session> session) {
+    // runs on the session's strand
+    coroutine_scope scope(server->serve_coroutine_count);
+    boost::system::error_code error;
+    auto completion_token =
+        boost::asio::redirect_error(boost::asio::use_awaitable, error);
+
+    co_await async_read(
+        session->stream.next_layer(), session->buffer, session->request,
+        completion_token
+    );
+
+    printf(
+        "T%s HTTP Read %s Method %s.\n",
+        boost::lexical_cast<std::string>(
+            std::this_thread::get_id()
+        ).c_str(),
+        boost::beast::buffers_to_string(
+            session->buffer.cdata()
+        ).c_str(),
+        session->request.method_string().data()
+    );
+
+    if(error == boost::beast::http::error::end_of_stream) {
+        co_return;
+    } else if (error) {
+        printf("Error %s.\n", error.message().c_str());
+        co_return;
+    }
+
+    if (!boost::beast::websocket::is_upgrade(session->request)) {
+        co_await respond(session);
+        co_return;
+    }
+
+    co_await session->stream.async_accept(session->request, completion_token);
+
+    printf(
+        "T%s WS Accept.\n",
+        boost::lexical_cast<std::string>(
+            std::this_thread::get_id()
+        ).c_str()
+    );
+    if (error) {
+        printf(
+            "Error %s.\n",
+            error.message().c_str()
+        );
+        co_return;
+    }
+
+    session->stream.binary(true);
+    if (preframed_writes) {
+        // bytes that were read after the upgrade request are frames already
+        session->frames.commit(boost::asio::buffer_copy(
+            session->frames.prepare(session->buffer.size()),
+            session->buffer.data()
+        ));
+        session->buffer.consume(session->buffer.size());
+    }
+
+    // the client's handshake comes first, ticks are only sent once it's
+    // answered
+    co_await receive(session, error);
+    if (error) {
+        printf("Error %s.\n", error.message().c_str());
+        co_return;
+    }
+    initial_message request(std::size(server_extensions) * 4);
+    if (parse(request, to_span(session->buffer)) != read_error::none) {
+        server->rejected_message_count++;
+        co_return;
+    }
+    session->buffer.consume(session->buffer.size());
+
+    auto response = negotiate(*session, request);
+    std::vector<std::uint8_t> response_buffer(capacity(response));
+    response_buffer.resize(write(response, response_buffer));
+    if (preframed_writes) {
+        // goes first in the outbound queue, before any tick
+        enqueue(session, make_frame(opcode::binary, response_buffer));
+    } else {
+        co_await session->stream.async_write(
+            boost::asio::buffer(response_buffer), completion_token
+        );
+        if (error) {
+            printf("Error %s.\n", error.message().c_str());
+            co_return;
+        }
+    }
+
+    {
+        std::scoped_lock lock(server->sessions_mutex);
+        server->sessions.push_back(session);
+    }
+
+    co_await read(session);
+
+    session->closed = true;
+}
+
+boost::asio::awaitable<void> accept(
+    boost::asio::io_context &context,
+    boost::asio::ip::tcp::acceptor& acceptor
+) {
+    coroutine_scope scope(server->accept_coroutine_count);
+    boost::system::error_code error;
+    auto completion_token =
+        boost::asio::redirect_error(boost::asio::use_awaitable, error);
+
+    // every session gets its own strand, so sessions can be served in parallel
+    boost::asio::ip::tcp::socket socket(boost::asio::make_strand(context));
+    co_await acceptor.async_accept(socket, completion_token);
+
+    if (error)
+        co_return;
+
+    printf(
+        "T%s Accept %s.\n",
+        boost::lexical_cast<std::string>(
+            std::this_thread::get_id()
+        ).c_str(),
+        boost::lexical_cast<std::string>(
+            socket.remote_endpoint(error)
+        ).c_str()
+    );
+
+    co_spawn(context, accept(context, acceptor), boost::asio::detached);
+
+    boost::intrusive_ptr<::session> session(
+        new ::session(std::move(socket))
+    );
+
+    co_spawn(
+        session->stream.get_executor(), serve(session), boost::asio::detached
+    );
+}
+
+void complete(tick_record &tick) {
+    if (--tick.pending == 0) {
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - tick.start
+        );
+        server->tick_duration_total += duration.count();
+        server->tick_durations.observe(duration);
+        server->tick_count++;
+    }
+}
+
+// frames without a tick don't count
+void complete(const tick_frame &frame) {
+    if (frame.tick)
+        complete(*frame.tick);
+}
+
+void send_next(boost::intrusive_ptr<session> session) {
+    // runs on the session's strand
+    if (session->outbound.empty()) {
+        session->writing = false;
+        return;
+    }
+    session->writing = true;
+    auto frame = std::move(session->outbound.front());
+    session->outbound.pop_front();
+    session->queue_depth = session->outbound.size();
+
+    auto completed =
+        [session, frame](boost::beast::error_code error, size_t) {
+            complete(*frame);
+            if (error) {
+                printf("Error %s.\n", error.message().c_str());
+                session->closed = true;
+                for (auto &frame : session->outbound)
+                    complete(*frame);
+                session->outbound.clear();
+                session->queue_depth = 0;
+                return;
+            }
+            if (frame->header[0] == (0x80 | opcode::close)) {
+                // the server closes the connection first
+                session->stream.next_layer().close(error);
+                session->closed = true;
+                session->writing = false;
+                return;
+            }
+            if (frame->tick) {
+                session->sent_frame_count++;
+                session->sent_byte_count += frame->buffer.size();
+                server->sent_frame_count++;
+                server->sent_byte_count += frame->buffer.size();
+            }
+            send_next(session);
+        };
+
+    if (preframed_writes) {
+        std::array<boost::asio::const_buffer, 2> buffers{
+            boost::asio::buffer(frame->header.data(), frame->header_size),
+            boost::asio::buffer(frame->buffer),
+        };
+        boost::asio::async_write(
+            session->stream.next_layer(), buffers, completed
+        );
+    } else {
+        session->stream.async_write(
+            boost::asio::buffer(frame->buffer), completed
+        );
+    }
+}
+
+void enqueue(
+    boost::intrusive_ptr<session> session,
+    std::shared_ptr<const tick_frame> frame
+) {
+    // runs on the session's strand
+    if (session->closed || session->closing) {
+        complete(*frame);
+        return;
+    }
+    session->closing = frame->header[0] == (0x80 | opcode::close);
+
+    if (frame->tick)
+        session->queued_frame_count++;
+
+    // A slow client only loses its own oldest ticks instead of stalling
+    // everyone else. Pongs and closes aren't dropped.
+    auto oldest = std::find_if(
+        session->outbound.begin(), session->outbound.end(),
+        [](auto &frame) { return frame->tick != nullptr; }
+    );
+    if (
+        session->outbound.size() >= outbound_queue_capacity &&
+        oldest != session->outbound.end()
+    ) {
+        complete(**oldest);
+        session->outbound.erase(oldest);
+        session->dropped_frame_count++;
+        server->dropped_frame_count++;
+    }
+    session->outbound.push_back(std::move(frame));
+    session->queue_depth = session->outbound.size();
+
+    if (!session->writing)
+        send_next(session);
+}
+
+void tick(boost::system::error_code error = {}) {
+    // runs on the tick strand
+    if (error) return;
+
+    auto record = std::make_shared<tick_record>();
+    record->start = std::chrono::steady_clock::now();
+
+    std::vector<boost::intrusive_ptr<session>> sessions;
+    {
+        std::scoped_lock lock(server->sessions_mutex);
+
+        // TODO: instead of using partition use swap erase
+        auto end = std::partition(
+            server->sessions.begin(), server->sessions.end(),
+            [](auto &session){ return !session->closed.load(); }
+        );
+
+        for (auto closed = end; closed != server->sessions.end(); closed++)
+            if ((*closed)->id != no_user_id)
+                server->free_user_ids.push_back((*closed)->id);
+
+        server->sessions.erase(
+            end, server->sessions.end()
+        );
+
+        sessions = server->sessions;
+    }
+
+    server->tick_number++;
+
+    // the room grows when more users join
+    server->room.clear();
+
+    // the last tick each session acknowledged
+    std::vector<std::uint32_t> acknowledged(sessions.size());
+    // index of each session's user in the room, -1 before its first pose
+    std::vector<int> users(sessions.size());
+    std::vector<room_user> room_users;
+    for (auto i = 0u; i < sessions.size(); i++) {
+        auto &session = sessions[i];
+        if (session->id == no_user_id) {
+            if (server->free_user_ids.empty()) {
+                session->id = server->user_id_count++;
+            } else {
+                session->id = server->free_user_ids.back();
+                server->free_user_ids.pop_back();
+            }
+        }
+
+        std::scoped_lock lock(session->mutex);
+        if (session->received.size() == 0) {
+            users[i] = -1;
+            continue;
+        }
+        // was checked when it was received
+        message_view view(to_span(session->received), server->room.bounds);
+        acknowledged[i] = view.tick;
+        users[i] = server->room.users.size;
+        server->room.append(view);
+        server->room.users.id[users[i]] = session->id;
+        // voice is sent once, later ticks only repeat the pose
+        auto size = voice_size(session->received);
+        std::fill(size.begin(), size.end(), 0);
+
+        // the first speed is off, which just gets the user sent sooner
+        auto position = user_position(server->room, users[i]);
+        room_users.push_back({
+            session->id,
+            glm::distance(position, session->previous_position) /
+                std::chrono::duration<float>(tick_time).count()
+        });
+        session->previous_position = position;
+    }
+
+    if (message_byte_budget > 0) {
+        // each session picks its own users
+    } else if (interest_radius > 0) {
+        server->interest.build(server->room, interest_radius);
+    } else {
+        // everyone gets the same users, as many as fit
+        auto user_count = std::min<unsigned>(
+            server->room.users.size, server->m.user_capacity
+        );
+        server->m.clear();
+        for (auto user = 0u; user < user_count; user++)
+            server->m.append(server->room, user);
+    }
+    server->m.tick = server->tick_number;
+
+    // the tick itself counts as pending, so the record can't complete while
+    // frames are still being handed out
+    record->pending = sessions.size() + 1;
+
+    // one shared frame with voice and one without
+    std::shared_ptr<const tick_frame> shared_frames[2];
+    auto encode = [&](const pose_snapshot *baseline) {
+        auto frame = std::make_shared<tick_frame>();
+        frame->tick = record;
+        // only send the bytes that are used by the current users
+        frame->buffer.resize(capacity(server->m));
+        frame->buffer.resize(
+            baseline ?
+            write(server->m, frame->buffer, *baseline) :
+            write(server->m, frame->buffer)
+        );
+        build_header(*frame, opcode::binary);
+        return frame;
+    };
+
+    for (auto i = 0u; i < sessions.size(); i++) {
+        auto &session = sessions[i];
+        bool individual = message_byte_budget > 0 || interest_radius > 0;
+        server->m.voice = session->voice;
+
+        const pose_snapshot *baseline = nullptr;
+        if (session->delta)
+            baseline = session->history.find(acknowledged[i]);
+
+        if (message_byte_budget > 0) {
+            session->priorities.select(
+                server->room, room_users, users[i], message_byte_budget,
+                baseline != nullptr, server->m
+            );
+        } else if (interest_radius > 0) {
+            server->interest.select(
+                server->room, users[i], server->tick_number, server->m
+            );
+        }
+        server->m.tick = server->tick_number;
+
+        std::shared_ptr<const tick_frame> frame;
+        if (baseline || individual) {
+            frame = encode(baseline);
+        } else {
+            // all sessions without a baseline get the same frame
+            auto &shared_frame = shared_frames[session->voice];
+            if (!shared_frame)
+                shared_frame = encode(nullptr);
+            frame = shared_frame;
+        }
+
+        // pushing may overwrite the baseline, so only after encoding
+        if (session->delta)
+            session->history.push(server->m);
+
+        // the stream may only be used from the session's strand
+        boost::asio::post(
+            session->stream.get_executor(), [session, frame]() {
+                enqueue(session, frame);
+            }
+        );
+    }
+
+    complete(*record);
+
+    // when a tick took too long, the ones that should have started meanwhile
+    // are skipped
+    auto now = std::chrono::steady_clock::now();
+    auto next = server->tick_timer.expiry() + tick_time;
+    if (now > next)
+        server->skipped_tick_count += (now - next) / tick_time;
+    server->tick_timer.expires_at(std::max(next, now));
+    server->tick_timer.async_wait(tick);
+}
+
+void start(server_t &server) {
+    ::server = &server;
+
+    server.acceptor.set_option(
+        boost::asio::ip::tcp::acceptor::reuse_address(true)
+    );
+
+    server.acceptor.listen();
+
+    co_spawn(
+        server.context, accept(server.context, server.acceptor),
+        boost::asio::detached
+    );
+
+    boost::asio::post(server.tick_strand, [](){ tick(); });
+}
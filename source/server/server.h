@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+
+#include "../network/network_message.h"
+#include "interest.h"
+#include "metrics.h"
+
+extern std::chrono::milliseconds tick_time;
+
+// maximum number of users in a message to a client, the room holds any number
+extern unsigned message_user_capacity;
+// initial capacity, grows with the voice packets that clients send
+extern unsigned message_audio_capacity;
+// number of ticks that can wait for a slow client before old ones are dropped
+extern unsigned outbound_queue_capacity;
+
+// send poses as deltas against the last tick each client acknowledged
+extern bool delta_encoding;
+// number of sent ticks that are remembered per session for delta encoding
+extern unsigned pose_history_length;
+// Write the websocket frames of ticks directly to the socket, see tick_frame
+extern bool preframed_writes;
+
+// extensions that clients may subscribe to, in the answer to their handshake
+extern const uuid server_extensions[4];
+
+// sessions get an id once they're part of a tick, ids of closed sessions are
+// reused
+const std::uint16_t no_user_id = 0xffff;
+
+struct tick_record {
+    std::chrono::steady_clock::time_point start;
+    // number of sessions that haven't sent or dropped their frame of this tick
+    std::atomic_uint pending = 0;
+};
+
+// A serialized tick, shared by all sessions that it is sent to and immutable
+// once it is handed to them. Frames from server to client are not masked, so
+// the websocket frame header is built once too. With preframed writes, the
+// frame is written to each socket as is, without Beast framing it again per
+// session. Beast would answer pings and closes on its own then, and its
+// frames could interleave with ticks, so those sessions don't read through
+// Beast either. Their pongs and closes wait in the outbound queue like ticks,
+// as frames without a tick.
+struct tick_frame {
+    std::vector<std::uint8_t> buffer;
+    std::array<std::uint8_t, 10> header;
+    std::size_t header_size = 0;
+    std::shared_ptr<tick_record> tick;
+};
+
+struct session : public boost::intrusive_ref_counter<session> {
+    // Need either ref counting or counting the number of outstanding operations
+    // The socket is expected to be bound to a strand. All operations on the
+    // stream have to be started from that strand.
+    session(boost::asio::ip::tcp::socket&& socket) :
+        stream(std::move(socket))
+    {
+        history.reset(pose_history_length, message_user_capacity);
+    }
+    boost::beast::http::request<boost::beast::http::string_body> request;
+    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> stream;
+    boost::beast::flat_buffer buffer;
+    // With preframed writes, bytes that were read but not parsed into frames
+    // yet, and whether buffer holds the start of a fragmented message. Only
+    // accessed on the session's strand.
+    boost::beast::flat_buffer frames;
+    bool fragmented = false;
+
+    // What the client subscribed to in the handshake, set before the session
+    // is added to the sessions
+    bool voice = false, delta = false;
+
+    // The last message that was received, not decoded until the tick views
+    // it. Swapped in by the read coroutine on the session's strand and read by
+    // the tick on the server's strand. Voice that no tick sent yet is kept
+    // until one does.
+    std::mutex mutex;
+    boost::beast::flat_buffer received;
+
+    // is_open can't be called from outside the session's strand
+    std::atomic_bool closed = false;
+
+    // async_write cannot be called before the last async_write completed, so
+    // ticks wait here. Only accessed on the session's strand.
+    std::deque<std::shared_ptr<const tick_frame>> outbound;
+    bool writing = false;
+    // once a close frame was queued, nothing is sent after it
+    bool closing = false;
+    // size of outbound, for the metrics
+    std::atomic_uint queue_depth = 0;
+
+    std::atomic_uint64_t
+        queued_frame_count = 0, dropped_frame_count = 0, sent_frame_count = 0,
+        sent_byte_count = 0;
+
+    // Only accessed on the tick strand:
+    // poses sent to this session
+    pose_history history;
+    std::uint16_t id = no_user_id;
+    // of this session's user, to estimate its speed
+    glm::vec3 previous_position{0, 0, 0};
+    // of the other users, from the view of this session
+    priority_accumulator priorities;
+};
+
+struct server_t {
+    server_t(boost::asio::io_context& context, unsigned short port);
+    // Need one state that can be written when messages arrive
+    // and one that can be read to send out messages
+    // TODO: how to reallocate positions when users join?
+    // on message: write to session positions
+    // on tick: copy from session positions to world positions
+
+    // sessions is appended to by accept on the sessions' strands
+    std::mutex sessions_mutex;
+    std::vector<boost::intrusive_ptr<session>> sessions;
+
+    boost::asio::io_context& context;
+    boost::asio::ip::tcp::acceptor acceptor;
+    // tick and everything it touches without a lock runs on this strand
+    boost::asio::strand<boost::asio::io_context::executor_type> tick_strand;
+    boost::asio::steady_timer tick_timer;
+    // 0 is reserved for no tick
+    std::uint32_t tick_number = 0;
+    message m;
+    // every user in the room, grows with the number of sessions
+    message room;
+    spatial_hash interest;
+    // ids that are free to be reused, and the number of ids handed out
+    std::vector<std::uint16_t> free_user_ids;
+    std::uint16_t user_id_count = 0;
+
+    // time from the start of a tick until the last session sent or dropped it
+    std::atomic_uint64_t tick_count = 0, tick_duration_total = 0;
+
+    // for the metrics, over all sessions that were ever connected
+    duration_histogram tick_durations;
+    std::atomic_uint64_t
+        skipped_tick_count = 0, received_byte_count = 0, sent_byte_count = 0,
+        sent_frame_count = 0, dropped_frame_count = 0,
+        rejected_message_count = 0;
+    std::atomic_int64_t
+        accept_coroutine_count = 0, serve_coroutine_count = 0,
+        read_coroutine_count = 0;
+};
+
+extern server_t* server;
+
+// Starts accepting connections and ticking. The context can then be run on
+// any number of threads.
+void start(server_t &server);
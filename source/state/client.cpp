@@ -1,41 +1,54 @@
 #include "client.h"
 
+#include <exception>
+
 #include "../utility/file.h"
 #include "../network/network_message.h"
 #include "../utility/serialization.h"
 
-// These may differ between server and client
+// Initial capacities, messages grow to whatever the server sends
 unsigned message_user_capacity = 16;
 unsigned message_audio_capacity = 200;
+// Users that weren't received for this many ticks are considered gone. Far
+// users may only be sent every few seconds.
+std::uint32_t user_timeout_ticks = 200;
+// needs to be longer than the server's history, so that every tick that the
+// server may use as a baseline is still known
+unsigned pose_history_length = 32;
+// Received frames that can wait for update, a few seconds of ticks for when
+// rendering stalls
+unsigned in_frame_capacity = 64;
+// The simulation runs at this rate, whatever the frame rate. Frames that took
+// longer than max_steps_per_frame steps slow it down instead.
+std::chrono::duration<float> step_time{1 / 60.f};
+unsigned max_steps_per_frame = 8;
+// the pose is sent every few steps, 50 ms like the server's ticks
+unsigned steps_per_send = 3;
+// in meters per second
+float walking_speed = 1;
 
 client::client(std::string_view server) {
-    auto test_file = read_file("test_files/AvatarSample_B.vrm");
-    test_model = model({test_file.data(), test_file.data() + test_file.size()});
-    auto world_file = read_file("test_files/white_modern_living_room.glb");
-    world_model = model({world_file.data(), world_file.data() + world_file.size()});
+    test_model = load_model("test_files/AvatarSample_B.vrm");
+    world_model = load_model("test_files/white_modern_living_room.glb");
 
+    in_message.reset(message_user_capacity, message_audio_capacity);
+    in_history.reset(pose_history_length, message_user_capacity);
+    // before connecting, frames are queued as soon as they arrive
+    in_frames.reset(in_frame_capacity);
+    for (auto &frame : in_frames.slots)
+        frame.buffer.reserve(capacity(in_message));
     connection.reset(
         new websocket(*this, event_loop, server)
     );
-    next_network_update = std::chrono::steady_clock::now();
-    in_message.reset(message_user_capacity, message_audio_capacity);
-    message_in_readable = false;
-    // TODO: Either use vector::reserve or use a different type.
-    // std::vector is almost the right type. But it is awkward to use with C API
-    in_buffer.resize(capacity(in_message));
     out_message.reset(message_user_capacity, message_audio_capacity);
     out_buffer.resize(capacity(out_message));
     encoded_audio_in.resize(message_audio_capacity);
-    users.encoded_audio_out_size.resize(message_user_capacity);
-    users.encoded_audio_out.resize(
-        message_user_capacity
-    );
-    for (auto &audio : users.encoded_audio_out) {
-        audio.resize(message_audio_capacity);
-    }
+    // handed out from the back, lowest first
+    for (unsigned source = audio_source_count; source-- > 0;)
+        free_sources.push_back(source);
 }
 
-void client::update(::input &input) {
+void client::update(::input &input, float delta) {
     glm::vec2 touch_rotation = {};
 
     for (int i = 0; i < input.touch.size; i++) {
@@ -75,80 +88,188 @@ void client::update(::input &input) {
     user_orientation =
         glm::rotate(user_orientation, user_pitch, {1, 0, 0});
 
-    input.motion = input.motion / glm::max(1.0f, glm::length(input.motion));
+    // user interface
+    input.prefer_pointer_locked = true;
+
+    step_accumulator = std::min(
+        step_accumulator + delta, max_steps_per_frame * step_time.count()
+    );
+    while (step_accumulator >= step_time.count()) {
+        step(input);
+        step_accumulator -= step_time.count();
+    }
+    user_position = glm::mix(
+        previous_simulated_position, simulated_position,
+        step_accumulator / step_time.count()
+    );
+
+    // Every frame that arrived is read, in order, so the ring doesn't fill up
+    // when frames are slow. Voice waits in each user's voice_queue.
+    while (auto frame = in_frames.front()) {
+        receive(*frame);
+        in_frames.pop();
+    }
+
+    // remote users are shown a little in the past, see playout_clock
+    if (playout.started) {
+        auto tick = playout.tick(std::chrono::steady_clock::now());
+        for (size_t slot = 0; slot < users.poses.size(); slot++)
+            if (users.present[slot])
+                users.poses[slot].sample(
+                    tick, users.position[slot], users.orientation[slot]
+                );
+    }
+}
 
-    user_position +=
-        user_orientation * glm::vec3(input.motion.x, 0, input.motion.y);
+void client::step(const ::input &input) {
+    previous_simulated_position = simulated_position;
+    auto motion = input.motion / glm::max(1.0f, glm::length(input.motion));
+    simulated_position +=
+        user_orientation * glm::vec3(motion.x, 0, motion.y) *
+        walking_speed * step_time.count();
 
     // physics
-    //user_position.z = glm::max(0.0f, user_position.z);
+    //simulated_position.z = glm::max(0.0f, simulated_position.z);
 
-    // user interface
-    input.prefer_pointer_locked = true;
+    // network, voice is sent as soon as it's encoded
+    bool pose_due = step_number++ % steps_per_send == 0;
+    if (!handshake_sent) {
+        // in_message grows to whatever voice the server sends
+        auto request = handshake_request();
+        auto size = write(request, out_buffer);
+        connection->write_message(
+            {out_buffer.data(), size}, outbound_kind::reliable
+        );
+        handshake_sent = true;
+    } else if (handshake_received && (pose_due || encoded_audio_in_size > 0)) {
+        out_message.users.size = 1;
+        // acknowledge the last received tick
+        out_message.tick = in_message.tick;
+
+        auto &p = out_message.users.position;
+        p[0] = simulated_position.x;
+        p[1] = simulated_position.y;
+        p[2] = simulated_position.z;
+
+        auto &o = out_message.users.orientation;
+        o[0] = user_orientation.x;
+        o[1] = user_orientation.y;
+        o[2] = user_orientation.z;
+        o[3] = user_orientation.w;
 
-    // network
-    auto now = std::chrono::steady_clock::now();
-    if (now > next_network_update) {
-        if (connection->is_write_completed()) {
-            out_message.users.size = 1;
-
-            auto &p = out_message.users.position;
-            p[0] = user_position.x;
-            p[1] = user_position.y;
-            p[2] = user_position.z;
-
-            auto &o = out_message.users.orientation;
-            o[0] = user_orientation.x;
-            o[1] = user_orientation.y;
-            o[2] = user_orientation.z;
-            o[3] = user_orientation.w;
-
-            out_message.users.voice[0].first = encoded_audio_in_size;
-            copy(
-                encoded_audio_in, 
-                std::views::all(out_message.users.voice[0].second)
-            );
+        // the server would drop the whole message
+        if (encoded_audio_in_size > server_audio_capacity)
             encoded_audio_in_size = 0;
+        bool voice = encoded_audio_in_size > 0;
+        out_message.users.voice[0].first = encoded_audio_in_size;
+        copy(
+            encoded_audio_in, 
+            std::views::all(out_message.users.voice[0].second)
+        );
+        encoded_audio_in_size = 0;
 
-            write(out_message, out_buffer);
+        auto size = write(out_message, out_buffer);
+
+        // Poses that wait behind a slow write are replaced by newer ones, voice
+        // only when too much of it waits
+        connection->write_message(
+            {out_buffer.data(), size},
+            voice ? outbound_kind::voice : outbound_kind::pose
+        );
+    }
+
+}
 
-            connection->try_write_message(out_buffer);
-            next_network_update = std::max(
-                now, next_network_update + std::chrono::milliseconds{50}
-            );
+void client::receive(received_frame &frame) {
+    if (!handshake_received) {
+        // the first message is the answer to the handshake
+        initial_message response(8);
+        if (parse(response, frame.buffer) != read_error::none) {
+            in_rejected_count++;
+            return;
         }
+        in_message.voice = has_extension(response, extensions::voice);
+        server_audio_capacity = response.audio_capacity;
+        handshake_received = true;
+        return;
     }
 
-    if (message_in_readable) {
-        read(in_message, in_buffer);
-        std::size_t user_count = in_message.users.size;
+    // voices are copied straight from the frame, if there are any
+    voice_view voices;
+    auto acknowledged = in_message.tick;
+    try {
+        voices = read_poses(in_message, frame.buffer, in_history);
+    } catch (const std::exception &) {
+        // Truncated, or delta encoded against a tick that is gone. The tick
+        // that is acknowledged stays the last one that was read.
+        in_message.tick = acknowledged;
+        in_rejected_count++;
+        return;
+    }
+    auto tick = in_message.tick;
+    playout.receive(tick, frame.arrival);
 
-        if (user_count != users.position.size()) {
-            users.position.resize(user_count);
-            users.orientation.resize(user_count);
+    auto voice = voices.begin();
+    for (size_t index = 0; index < in_message.users.size; index++) {
+        auto slot = in_message.users.id[index];
+        if (slot >= users.position.size()) {
+            users.position.resize(slot + 1);
+            users.orientation.resize(slot + 1);
+            users.poses.resize(slot + 1);
+            users.voice.resize(slot + 1);
+            users.source.resize(slot + 1, -1);
+            users.present.resize(slot + 1);
+            users.last_tick.resize(slot + 1);
+        }
+        if (!users.present[slot]) {
+            // the id may have been someone else's
+            users.poses[slot].clear();
+            users.present[slot] = true;
             update_number++;
         }
+        users.last_tick[slot] = tick;
 
-        for (size_t index = 0; index < user_count; index++) {
-            auto &p = in_message.users.position;
-            users.position[index].x = p[index * 3 + 0];
-            users.position[index].y = p[index * 3 + 1];
-            users.position[index].z = p[index * 3 + 2];
-
-            auto &o = in_message.users.orientation;
-            users.orientation[index].x = o[index * 4 + 0];
-            users.orientation[index].y = o[index * 4 + 1];
-            users.orientation[index].z = o[index * 4 + 2];
-            users.orientation[index].w = o[index * 4 + 3];
-
-            users.encoded_audio_out_size[index] = 
-                in_message.users.voice[index].first;
-            copy(
-                in_message.users.voice[index].second, 
-                std::views::all(users.encoded_audio_out[index])
-            );
+        auto &p = in_message.users.position;
+        auto &o = in_message.users.orientation;
+        glm::vec3 position(
+            p[index * 3 + 0], p[index * 3 + 1], p[index * 3 + 2]
+        );
+        glm::quat orientation;
+        orientation.x = o[index * 4 + 0];
+        orientation.y = o[index * 4 + 1];
+        orientation.z = o[index * 4 + 2];
+        orientation.w = o[index * 4 + 3];
+        users.poses[slot].push(tick, position, orientation);
+
+        if (voice == voices.end())
+            continue;
+        auto audio = *voice;
+        ++voice;
+        if (audio.empty())
+            continue;
+        if (users.source[slot] == -1 && !free_sources.empty()) {
+            // the source may have played someone else's voice
+            users.source[slot] = free_sources.back();
+            free_sources.pop_back();
+            source_reset[users.source[slot]] = true;
         }
+        // users that didn't get a source aren't heard
+        if (users.source[slot] != -1)
+            users.voice[slot].push(audio);
+    }
 
-        message_in_readable = false;
+    for (size_t slot = 0; slot < users.present.size(); slot++) {
+        if (
+            users.present[slot] &&
+            tick - users.last_tick[slot] > user_timeout_ticks
+        ) {
+            users.present[slot] = false;
+            users.voice[slot].clear();
+            if (users.source[slot] != -1) {
+                free_sources.push_back(users.source[slot]);
+                users.source[slot] = -1;
+            }
+            update_number++;
+        }
     }
 }
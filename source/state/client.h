@@ -12,14 +12,40 @@
 #include "input.h"
 #include "../network/websocket.h"
 #include "../network/network_message.h"
+#include "../utility/spsc_ring.h"
 #include "model.h"
+#include "pose_buffer.h"
+#include "voice_queue.h"
+
+struct received_frame {
+    std::vector<std::uint8_t> buffer;
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// Voices that can be heard at once. Users get an audio source when they first
+// speak and give it back when they leave.
+constexpr unsigned audio_source_count = 32;
 
 struct client {
     client(std::string_view server);
     // TODO: maybe this function should not be in this struct
-    void update(::input& input);
+    // Once per frame, delta is the time since the last frame in seconds. Runs
+    // as many steps as fit into the time that wasn't simulated yet.
+    void update(::input& input, float delta);
+    // A fixed step of the simulation, which also sends the user's pose. Runs
+    // on the render thread, see notes/Data Flow.md.
+    void step(const ::input& input);
+    // reads a received frame, voices are queued for audio
+    void receive(received_frame &frame);
 
+    // Shown, between the last two simulated positions by the time that
+    // wasn't simulated yet
     glm::vec3 user_position {0, 0, 0};
+    glm::vec3 simulated_position {0, 0, 0};
+    glm::vec3 previous_simulated_position {0, 0, 0};
+    // seconds
+    float step_accumulator = 0;
+    unsigned step_number = 0;
     float user_pitch = glm::radians(90.f), user_yaw = 0;
     glm::quat user_orientation {0, 0, 0, 1};
 
@@ -33,31 +59,57 @@ struct client {
     // buffered
     unsigned time;
     unsigned update_number = 0;
+    // indexed by user id, users that left keep their slot until the id is
+    // reused
     struct {
         // TODO: maybe only use the message class
+        // as shown, interpolated between the received poses
         std::vector<glm::vec3> position;
         std::vector<glm::quat> orientation;
+        std::vector<pose_buffer> poses;
         std::vector<unsigned> avatar;
         
-        std::vector<unsigned> encoded_audio_out_size;
-        std::vector<std::vector<std::uint8_t>> encoded_audio_out;
+        // until audio plays them, only for users with a source
+        std::vector<voice_queue> voice;
+        // the audio source that plays the voice, or -1 if there is none
+        std::vector<int> source;
+
+        // whether the slot is used, and the last tick it was received in
+        std::vector<bool> present;
+        std::vector<std::uint32_t> last_tick;
     } users;
 
+    // Audio sources that aren't used by any user. Sources that were handed to
+    // another user need their decoder reset before playing its voice.
+    std::vector<unsigned> free_sources;
+    bool source_reset[audio_source_count] = {};
+
     std::string world_path;
 
     model test_model, world_model;
     
-    std::chrono::steady_clock::time_point next_network_update;
+
+    // The handshake is sent before any pose and answered before any tick.
+    // Voice that the server doesn't accept isn't sent.
+    bool handshake_sent = false, handshake_received = false;
+    unsigned server_audio_capacity = 0;
 
     // out-going
     message out_message;
     std::vector<std::uint8_t> out_buffer;
 
     // in-comming
-    // TODO: might need a queue for delta compression
     message in_message;
-    std::vector<std::uint8_t> in_buffer;
-    std::atomic_bool message_in_readable;
+    // received poses that the server may send deltas against
+    pose_history in_history;
+    // Frames are queued by the network thread and read by update, in order.
+    // Frames that arrive while all slots are taken are dropped and counted.
+    spsc_ring<received_frame> in_frames;
+    std::atomic_uint64_t in_frame_count = 0, in_overrun_count = 0;
+    // frames that couldn't be read and were dropped, only counted by update
+    std::uint64_t in_rejected_count = 0;
+    // measures the jitter of received ticks, only used by update
+    playout_clock playout;
 
     // TODO: maybe should be in another struct
     ::event_loop event_loop;
@@ -4,6 +4,8 @@
 
 struct input {
     glm::vec2 pointer_position;
+    // Motion is the walking direction, up to 1 on each axis, the simulation
+    // scales it by its own time. Rotation is how far to turn in this frame.
     glm::vec2 motion, rotation;
 
     bool pointer_locked;
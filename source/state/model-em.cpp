@@ -1,5 +1,8 @@
 #include "model.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 #include <emscripten.h>
 
 EM_ASYNC_JS(
@@ -48,12 +51,19 @@ EM_ASYNC_JS(
     }
 );
 
-std::vector<uint8_t> read_png(
-    std::ranges::subrange<uint8_t*> file,
-    unsigned &width, unsigned &height
+void read_png(
+    std::ranges::subrange<uint8_t*> file, std::span<uint8_t> pixels,
+    unsigned width, unsigned height
 ) {
-    const char* pixels = read_png_js(file.begin(), file.end(), &width, &height);
-    std::vector<uint8_t> vector(pixels, pixels + width * height * 4);
-    free((void*)pixels);
-    return vector;
+    unsigned decoded_width = 0, decoded_height = 0;
+    const char* decoded = read_png_js(
+        file.begin(), file.end(), &decoded_width, &decoded_height
+    );
+    bool correct =
+        decoded_width == width && decoded_height == height &&
+        pixels.size() >= size_t(width) * height * 4;
+    if (correct)
+        std::copy(decoded, decoded + size_t(width) * height * 4, pixels.data());
+    free((void*)decoded);
+    parse_check(correct);
 }
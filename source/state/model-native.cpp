@@ -2,9 +2,9 @@
 
 #include <png.h>
 
-std::vector<uint8_t> read_png(
-    std::ranges::subrange<uint8_t*> file,
-    unsigned &width, unsigned &height
+void read_png(
+    std::ranges::subrange<uint8_t*> file, std::span<uint8_t> pixels,
+    unsigned width, unsigned height
 ) {
     // TODO: create RAII wrapper
     png_structp png = png_create_read_struct(
@@ -12,13 +12,22 @@ std::vector<uint8_t> read_png(
     );
     parse_check(png);
     png_infop info = png_create_info_struct(png);
+    if (!info)
+        png_destroy_read_struct(&png, nullptr, nullptr);
     parse_check(info);
 
+    // Local variables that change after setjmp must be volatile. Nothing with
+    // a destructor may be created or resized after it, since errors jump back
+    // past that, so the rows are allocated before and only filled in after.
+    volatile bool correct = false;
+    std::vector<uint8_t*> rows(height);
     if (!setjmp(png_jmpbuf(png))) {
         png_set_read_fn(
             png, &file, [](png_structp png, png_bytep destination, size_t size){
                 auto view = 
                     (std::ranges::subrange<uint8_t*> *)png_get_io_ptr(png);
+                if (view->size() < size)
+                    png_error(png, "unexpected end of file");
                 std::copy(view->data(), view->data() + size, destination);
                 *view = {view->begin() + size, view->end()};
             }
@@ -26,8 +35,6 @@ std::vector<uint8_t> read_png(
 
         png_read_info(png, info);
 
-        width = png_get_image_width(png, info);
-        height = png_get_image_height(png, info);
         auto color_type = png_get_color_type(png, info);
         auto bit_depth  = png_get_bit_depth(png, info);
 
@@ -58,17 +65,20 @@ std::vector<uint8_t> read_png(
 
         png_read_update_info(png, info);
 
-        std::vector<uint8_t> pixels(width * height * 4);
-        std::vector<uint8_t*> rows(height);
-        for (auto r = 0u; r < height; r++) {
-            rows[r] = pixels.data() + r * width * 4;
-        }
+        if (
+            png_get_image_width(png, info) == width &&
+            png_get_image_height(png, info) == height &&
+            pixels.size() >= size_t(width) * height * 4
+        ) {
+            for (auto r = 0u; r < height; r++) {
+                rows[r] = pixels.data() + size_t(r) * width * 4;
+            }
 
-        png_read_image(png, rows.data());
-        
-        return pixels;
+            png_read_image(png, rows.data());
+            correct = true;
+        }
     }
 
     png_destroy_read_struct(&png, &info, nullptr);
-    return {};
+    parse_check(correct);
 }
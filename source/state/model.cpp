@@ -4,11 +4,24 @@
 #include <exception>
 #include <csetjmp>
 #include <bit>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <memory>
 
 #include <boost/json.hpp>
 #include <boost/static_string.hpp>
 
 #include "../utility/math.h"
+#include "../utility/parallel_for.h"
+
+unsigned model_thread_count = 0;
+const char *model_cache_extension = ".model";
+// increased whenever the cache file or anything in model changes
+const uint32_t model_cache_version = 3;
 
 template<std::integral T>
 T read(std::ranges::subrange<uint8_t*> &b) {
@@ -36,6 +49,33 @@ void write(std::ranges::subrange<uint8_t*> &b, T value) {
     b = {b.begin() + sizeof(T), b.end()};
 }
 
+glm::vec3 read_vec3(std::ranges::subrange<uint8_t*> b, size_t index) {
+    b = {b.begin() + index * 12, b.end()};
+    glm::vec3 v;
+    v.x = std::bit_cast<float>(read<uint32_t>(b));
+    v.y = std::bit_cast<float>(read<uint32_t>(b));
+    v.z = std::bit_cast<float>(read<uint32_t>(b));
+    return v;
+}
+
+glm::vec2 read_vec2(std::ranges::subrange<uint8_t*> b, size_t index) {
+    b = {b.begin() + index * 8, b.end()};
+    glm::vec2 v;
+    v.x = std::bit_cast<float>(read<uint32_t>(b));
+    v.y = std::bit_cast<float>(read<uint32_t>(b));
+    return v;
+}
+
+// x from -1 to 1 to 16 bit signed normalized
+int16_t snorm16(float x) {
+    return int16_t(std::round(std::clamp(x, -1.f, 1.f) * 32767));
+}
+
+// x from 0 to 1 to unsigned normalized with this many bits
+uint32_t unorm(float x, unsigned bits) {
+    return uint32_t(std::round(std::clamp(x, 0.f, 1.f) * ((1u << bits) - 1)));
+}
+
 struct parse_exception : public std::exception {
     const char* what() const noexcept override {
         return "parse_exception\n";
@@ -48,6 +88,30 @@ void parse_check(bool correct) {
     }
 }
 
+bool read_png_size(
+    std::ranges::subrange<uint8_t*> file, unsigned &width, unsigned &height
+) {
+    // the signature, then the length and type of the IHDR chunk, which always
+    // comes first and starts with the big-endian width and height
+    const uint8_t start[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+        0, 0, 0, 13, 'I', 'H', 'D', 'R'
+    };
+    if (
+        file.size() < 24 ||
+        !std::equal(std::begin(start), std::end(start), file.begin())
+    )
+        return false;
+    auto big_endian = [&file](unsigned offset) {
+        return
+            uint32_t(file[offset]) << 24 | uint32_t(file[offset + 1]) << 16 |
+            uint32_t(file[offset + 2]) << 8 | uint32_t(file[offset + 3]);
+    };
+    width = big_endian(16);
+    height = big_endian(20);
+    return true;
+}
+
 enum struct state {
     root,
     asset,
@@ -366,6 +430,10 @@ struct handler {
             if (key == "index") {
                 materials.back().pbr_metallic_roughness_base_color_texture = i;
             }
+        } else if (state == state::nodes_n_matrix && array_index < 16) {
+            // whole numbers in a matrix, like 0 and 1, may be written as such
+            nodes.back().matrix[array_index / 4][array_index % 4] = i;
+            array_index++;
         } else if (state == state::nodes_n && key == "mesh") {
             nodes.back().mesh = i;
         } else if (state == state::nodes_n_children) {
@@ -461,8 +529,39 @@ model::model(std::ranges::subrange<uint8_t*> file) {
     parse_check(read<uint32_t>(file) == 0x004E4942); // chunk type == BIN
 
 
+    // The bytes of an accessor with elements of size bytes. Checked here, so
+    // that the conversion can't read past the file.
+    auto source = [&](uint32_t a, uint32_t size) {
+        auto v = h.accessors[a].buffer_view;
+        parse_check(
+            h.buffer_views[v].stride == 0 || h.buffer_views[v].stride == size
+        );
+        uint64_t offset = uint64_t(h.accessors[a].offset) +
+            h.buffer_views[v].offset;
+        uint64_t length = uint64_t(h.accessors[a].count) * size;
+        parse_check(offset + length <= file.size());
+        return std::ranges::subrange<uint8_t*>(
+            file.data() + offset, file.data() + offset + length
+        );
+    };
+
+    // 16 bit indices can address this many
+    const size_t part_vertex_capacity = 1 << 16;
+
+    // A part of a primitive that fits 16 bit indices. Those that fit as a
+    // whole have no vertex list and take all vertices in order. Others are
+    // split up by triangles in order.
+    struct part {
+        uint32_t source;
+        // source vertices and indices into them, when split
+        std::vector<uint32_t> vertices;
+        std::vector<uint16_t> indices;
+    };
+
+    // The world matrices of the nodes that use each primitive. Primitives
+    // that no node uses aren't loaded.
+    std::vector<std::vector<glm::mat4>> node_matrices(h.primitives.size());
     for (node_info& node : h.nodes) {
-        // TODO: don't duplicate data per node and primitive
         if (node.mesh == ~0u)
             continue;
 
@@ -473,105 +572,467 @@ model::model(std::ranges::subrange<uint8_t*> file) {
             parent = h.nodes[parent].parent;
         }
 
-        for (auto p : h.meshes[node.mesh].primitives) {
-            auto start_index = positions.size() / 12;
-
-            primitives.push_back({
-                static_cast<uint32_t>(start_index),
-                static_cast<uint32_t>(indices.size() / 4),
-                h.accessors[h.primitives[p].indices].count,
-                h.materials[h.primitives[p].material].
-                pbr_metallic_roughness_base_color_texture
-            });
-
-            auto a = h.primitives[p].positions;
-            auto v = h.accessors[a].buffer_view;
-            auto offset = h.accessors[a].offset + h.buffer_views[v].offset;
-            parse_check(
-                h.buffer_views[v].stride == 0 || h.buffer_views[v].stride == 12
-            );
-            std::ranges::subrange<uint8_t*> file_range = {
-                file.data() + offset, 
-                file.begin() + offset + h.accessors[a].count * 12
-            };
-            auto begin = positions.insert(
-                positions.end(),
-                file.begin() + offset,
-                file.begin() + offset + h.accessors[a].count * 12
-            );
-            std::ranges::subrange position_range = {
-                std::to_address(begin), std::to_address(positions.end())
-            };
-            for (unsigned i = 0; i < h.accessors[a].count; i++) {
-                glm::vec3 position;
-                position.x = std::bit_cast<float>(read<uint32_t>(file_range));
-                position.y = std::bit_cast<float>(read<uint32_t>(file_range));
-                position.z = std::bit_cast<float>(read<uint32_t>(file_range));
-                position = matrix * glm::vec4(position, 1.0);
-                write(position_range, std::bit_cast<uint32_t>(position.x));
-                write(position_range, std::bit_cast<uint32_t>(position.y));
-                write(position_range, std::bit_cast<uint32_t>(position.z));
+        for (auto p : h.meshes[node.mesh].primitives)
+            node_matrices[p].push_back(matrix);
+    }
+
+    // First, everything is placed, so that the slow part can be done in any
+    // order on several threads, each writing its own part of the vectors.
+    std::vector<part> parts;
+    uint32_t vertex_total = 0, index_total = 0;
+    auto add_part = [&](part &&p, uint32_t image, size_t vertex_count) {
+        auto index_count = p.vertices.empty() ?
+            h.accessors[h.primitives[p.source].indices].count :
+            p.indices.size();
+        parse_check(
+            uint64_t(vertex_total) + vertex_count <= UINT32_MAX &&
+            uint64_t(index_total) + index_count <= UINT32_MAX
+        );
+        // each part of a primitive is drawn for all of its nodes
+        auto &matrices = node_matrices[p.source];
+        primitives.push_back({
+            vertex_total, index_total, uint32_t(index_count), image,
+            uint32_t(instances.size()), uint32_t(matrices.size())
+        });
+        instances.insert(instances.end(), matrices.begin(), matrices.end());
+        parts.push_back(std::move(p));
+        vertex_total += vertex_count;
+        index_total += index_count;
+    };
+    for (auto p = 0u; p < h.primitives.size(); p++) {
+        if (node_matrices[p].empty())
+            continue;
+
+        auto &primitive = h.primitives[p];
+        auto count = h.accessors[primitive.positions].count;
+        parse_check(
+            h.accessors[primitive.normals].count == count &&
+            h.accessors[primitive.texture_coordinates].count == count
+        );
+        auto &index_accessor = h.accessors[primitive.indices];
+        parse_check(index_accessor.type == component_type::unsigned_int);
+        auto image = h.materials[primitive.material].
+            pbr_metallic_roughness_base_color_texture;
+
+        if (count <= part_vertex_capacity) {
+            add_part({p}, image, count);
+            continue;
+        }
+
+        auto old_indices = source(primitive.indices, 4);
+        parse_check(index_accessor.count % 3 == 0);
+        // where each source vertex is in the current part
+        std::vector<uint32_t> remap(count, ~0u);
+        part current{p};
+        while (!old_indices.empty()) {
+            if (current.vertices.size() + 3 > part_vertex_capacity) {
+                for (auto vertex : current.vertices)
+                    remap[vertex] = ~0u;
+                auto size = current.vertices.size();
+                add_part(std::move(current), image, size);
+                current = {p};
+            }
+            for (auto corner = 0u; corner < 3; corner++) {
+                auto vertex = read<uint32_t>(old_indices);
+                parse_check(vertex < count);
+                if (remap[vertex] == ~0u) {
+                    remap[vertex] = current.vertices.size();
+                    current.vertices.push_back(vertex);
+                }
+                current.indices.push_back(remap[vertex]);
             }
+        }
+        auto size = current.vertices.size();
+        add_part(std::move(current), image, size);
+    }
 
-            a = h.primitives[p].normals;
-            v = h.accessors[a].buffer_view;
-            offset = h.accessors[a].offset + h.buffer_views[v].offset;
-            parse_check(
-                h.buffer_views[v].stride == 0 || h.buffer_views[v].stride == 12
-            );
-            normals.insert(
-                normals.end(),
-                file.begin() + offset,
-                file.begin() + offset + h.accessors[a].count * 12
+    std::vector<std::ranges::subrange<uint8_t*>> image_files;
+    uint64_t pixel_total = 0;
+    for (auto v : h.images) {
+        uint64_t offset = h.buffer_views[v].offset;
+        uint64_t length = h.buffer_views[v].length;
+        parse_check(offset + length <= file.size());
+        image_files.push_back({
+            file.data() + offset, file.data() + offset + length
+        });
+        uint32_t width, height;
+        parse_check(read_png_size(image_files.back(), width, height));
+        uint64_t size = uint64_t(width) * height * 4;
+        parse_check(pixel_total + size <= UINT32_MAX);
+        images.push_back({
+            static_cast<uint32_t>(pixel_total), static_cast<uint32_t>(size),
+            width, height
+        });
+        pixel_total += size;
+    }
+
+    allocate({
+        size_t(vertex_total) * 8, size_t(vertex_total) * 4,
+        size_t(vertex_total) * 4, size_t(index_total) * 2, pixel_total
+    });
+
+    auto convert = [&](unsigned j) {
+        auto &part = parts[j];
+        auto &primitive = h.primitives[part.source];
+        auto &result = primitives[j];
+        size_t vertex_count = part.vertices.empty() ?
+            h.accessors[primitive.positions].count : part.vertices.size();
+        auto source_vertex = [&part](size_t i) -> size_t {
+            return part.vertices.empty() ? i : part.vertices[i];
+        };
+
+        std::ranges::subrange<uint8_t*> new_indices(
+            indices.data() + size_t(result.face_begin) * 2,
+            indices.data() + size_t(result.face_begin + result.face_size) * 2
+        );
+        if (part.vertices.empty()) {
+            auto old_indices = source(primitive.indices, 4);
+            while (!old_indices.empty()) {
+                auto vertex = read<uint32_t>(old_indices);
+                parse_check(vertex < vertex_count);
+                write<uint16_t>(new_indices, vertex);
+            }
+        } else {
+            for (auto vertex : part.indices)
+                write<uint16_t>(new_indices, vertex);
+        }
+
+        if (vertex_count == 0)
+            return;
+
+        auto old_positions = source(primitive.positions, 12);
+        glm::vec3 minimum, maximum;
+        for (auto i = 0u; i < vertex_count; i++) {
+            auto position = read_vec3(old_positions, source_vertex(i));
+            minimum = i == 0 ? position : glm::min(minimum, position);
+            maximum = i == 0 ? position : glm::max(maximum, position);
+        }
+        result.position_offset = (minimum + maximum) * 0.5f;
+        result.position_scale = (maximum - minimum) * 0.5f;
+        // flat along an axis, any value works there
+        auto divisor = glm::max(result.position_scale, glm::vec3(1e-30f));
+        std::ranges::subrange<uint8_t*> position_range = {
+            positions.data() + size_t(result.vertex_begin) * 8,
+            positions.data() + (result.vertex_begin + vertex_count) * 8
+        };
+        for (auto i = 0u; i < vertex_count; i++) {
+            auto position = read_vec3(old_positions, source_vertex(i));
+            position = (position - result.position_offset) / divisor;
+            write(position_range, snorm16(position.x));
+            write(position_range, snorm16(position.y));
+            write(position_range, snorm16(position.z));
+            write<int16_t>(position_range, 0);
+        }
+
+        auto old_normals = source(primitive.normals, 12);
+        std::ranges::subrange<uint8_t*> normal_range = {
+            normals.data() + size_t(result.vertex_begin) * 4,
+            normals.data() + (result.vertex_begin + vertex_count) * 4
+        };
+        for (auto i = 0u; i < vertex_count; i++) {
+            // from -1 to 1
+            auto normal =
+                read_vec3(old_normals, source_vertex(i)) * 0.5f + 0.5f;
+            write<uint32_t>(
+                normal_range,
+                unorm(normal.x, 10) | unorm(normal.y, 10) << 10 |
+                unorm(normal.z, 10) << 20
             );
+        }
 
-            a = h.primitives[p].texture_coordinates;
-            v = h.accessors[a].buffer_view;
-            offset = h.accessors[a].offset + h.buffer_views[v].offset;
-            parse_check(
-                h.buffer_views[v].stride == 0 || h.buffer_views[v].stride == 8
+        auto old_texture_coordinates = source(primitive.texture_coordinates, 8);
+        glm::vec2 lowest, highest;
+        for (auto i = 0u; i < vertex_count; i++) {
+            auto texture_coordinate =
+                read_vec2(old_texture_coordinates, source_vertex(i));
+            lowest = i == 0 ?
+                texture_coordinate : glm::min(lowest, texture_coordinate);
+            highest = i == 0 ?
+                texture_coordinate : glm::max(highest, texture_coordinate);
+        }
+        result.texture_coordinate_offset = lowest;
+        result.texture_coordinate_scale = highest - lowest;
+        auto texture_coordinate_divisor =
+            glm::max(result.texture_coordinate_scale, glm::vec2(1e-30f));
+        std::ranges::subrange<uint8_t*> texture_coordinate_range = {
+            texture_coordinates.data() + size_t(result.vertex_begin) * 4,
+            texture_coordinates.data() +
+                (result.vertex_begin + vertex_count) * 4
+        };
+        for (auto i = 0u; i < vertex_count; i++) {
+            auto texture_coordinate =
+                read_vec2(old_texture_coordinates, source_vertex(i));
+            texture_coordinate =
+                (texture_coordinate - lowest) / texture_coordinate_divisor;
+            write<uint16_t>(
+                texture_coordinate_range, unorm(texture_coordinate.x, 16)
             );
-            texture_coordinates.insert(
-                texture_coordinates.end(),
-                file.begin() + offset,
-                file.begin() + offset + h.accessors[a].count * 8
+            write<uint16_t>(
+                texture_coordinate_range, unorm(texture_coordinate.y, 16)
             );
+        }
+    };
 
-            a = h.primitives[p].indices;
-            v = h.accessors[a].buffer_view;
-            offset = h.accessors[a].offset + h.buffer_views[v].offset;
+#ifdef __EMSCRIPTEN__
+    // no threads, and the browser decodes images on the main thread anyway
+    unsigned thread_count = 1;
+#else
+    unsigned thread_count = model_thread_count ?
+        model_thread_count : std::max(1u, std::thread::hardware_concurrency());
+#endif
 
-            parse_check(h.accessors[a].type == component_type::unsigned_int);
-            auto new_indices_begin = indices.size();
-            indices.resize(indices.size() + h.accessors[a].count * 4);
-            std::ranges::subrange<uint8_t*> new_indices(
-                indices.data() + new_indices_begin, 
-                indices.data() + indices.size()
-            );
-            std::ranges::subrange<uint8_t*> old_indices(
-                file.data() + offset, file.data() + offset + new_indices.size()
+    // images take longest, so they are started first
+    parallel_for(
+        images.size() + primitives.size(), thread_count, [&](unsigned i) {
+            if (i >= images.size())
+                return convert(i - images.size());
+            auto &image = images[i];
+            read_png(
+                image_files[i], {pixels.data() + image.begin, image.size},
+                image.width, image.height
             );
+        }
+    );
+}
 
-            while (!old_indices.empty()) {
-                write<uint32_t>(new_indices, read<uint32_t>(old_indices));
-            }
+// round_up is for 32 bits
+uint64_t align_array(uint64_t offset) {
+    return
+        (offset + model_array_alignment - 1) / model_array_alignment *
+        model_array_alignment;
+}
+
+std::array<std::span<uint8_t>*, 5> model::arrays() {
+    return {&positions, &normals, &texture_coordinates, &indices, &pixels};
+}
+
+void model::allocate(std::array<size_t, 5> sizes) {
+    std::array<size_t, 5> offsets;
+    size_t total = 0;
+    for (auto i = 0u; i < sizes.size(); i++) {
+        offsets[i] = total;
+        total = align_array(total + sizes[i]);
+    }
+    storage.resize(total);
+    for (auto i = 0u; i < sizes.size(); i++)
+        *arrays()[i] = {storage.data() + offsets[i], sizes[i]};
+}
+
+// Not a standard hash, four lanes like xxHash so that the multiplications
+// don't wait for each other. Only compared with what this function returned
+// before.
+uint64_t content_hash(std::span<const uint8_t> b) {
+    const uint64_t prime_1 = 0x9e3779b185ebca87, prime_2 = 0xc2b2ae3d27d4eb4f;
+    uint64_t lanes[4] = {prime_1, prime_2, 0, ~prime_1};
+    auto mix = [&](uint64_t lane, uint64_t word) {
+        return std::rotl(lane + word * prime_2, 31) * prime_1;
+    };
+    size_t i = 0;
+    for (; i + 32 <= b.size(); i += 32) {
+        for (auto l = 0u; l < 4; l++) {
+            uint64_t word;
+            std::memcpy(&word, b.data() + i + l * 8, 8);
+            lanes[l] = mix(lanes[l], word);
         }
     }
+    uint64_t hash = b.size();
+    for (auto lane : lanes)
+        hash = mix(hash, lane);
+    for (; i < b.size(); i++)
+        hash = mix(hash, b[i]);
+    hash ^= hash >> 33;
+    hash *= prime_2;
+    hash ^= hash >> 29;
+    return hash;
+}
 
-    for (auto i = 0ul; i < h.images.size(); i++) {
-        auto v = h.images[i];
-        auto offset = h.buffer_views[v].offset;
-        auto length = h.buffer_views[v].length;
-        uint32_t width, height;
-        auto image = read_png(
-            {file.data() + offset, file.data() + offset + length},
-            width, height
+// At the start of a cache file. The primitives, images and instances follow,
+// then the arrays at their offsets. Everything is in the native byte order,
+// files from other machines have another magic number.
+struct cache_header {
+    uint32_t magic = 0x6c646f6d; // "modl" in little-endian
+    uint32_t version = model_cache_version;
+    uint32_t primitive_size = sizeof(model::mesh_primitive);
+    uint32_t image_size = sizeof(model::image);
+    uint64_t source_hash, source_size;
+    uint64_t primitive_count, image_count, instance_count;
+    std::array<uint64_t, 5> offsets, sizes;
+};
+
+// false if the cache doesn't fit the source, then m is unchanged
+bool read_cache(
+    model &m, mapped_file &&cache, uint64_t source_hash, uint64_t source_size
+) {
+    cache_header header, expected;
+    if (cache.size < sizeof(header))
+        return false;
+    std::memcpy(&header, cache.data, sizeof(header));
+    if (
+        header.magic != expected.magic ||
+        header.version != expected.version ||
+        header.primitive_size != expected.primitive_size ||
+        header.image_size != expected.image_size ||
+        header.source_hash != source_hash ||
+        header.source_size != source_size
+    )
+        return false;
+
+    uint64_t primitive_bytes =
+        header.primitive_count * sizeof(model::mesh_primitive);
+    uint64_t image_bytes = header.image_count * sizeof(model::image);
+    uint64_t instance_bytes = header.instance_count * sizeof(glm::mat4);
+    // each check also keeps the next one from overflowing
+    if (
+        header.primitive_count > cache.size ||
+        header.image_count > cache.size ||
+        header.instance_count > cache.size ||
+        sizeof(header) + primitive_bytes + image_bytes + instance_bytes >
+            cache.size
+    )
+        return false;
+    for (auto i = 0u; i < header.offsets.size(); i++)
+        if (
+            header.offsets[i] > cache.size ||
+            header.sizes[i] > cache.size - header.offsets[i] ||
+            header.offsets[i] % model_array_alignment != 0
+        )
+            return false;
+
+    std::vector<model::mesh_primitive> primitives(header.primitive_count);
+    std::memcpy(
+        primitives.data(), cache.data + sizeof(header), primitive_bytes
+    );
+    std::vector<model::image> images(header.image_count);
+    std::memcpy(
+        images.data(), cache.data + sizeof(header) + primitive_bytes,
+        image_bytes
+    );
+    std::vector<glm::mat4> instances(header.instance_count);
+    std::memcpy(
+        instances.data(),
+        cache.data + sizeof(header) + primitive_bytes + image_bytes,
+        instance_bytes
+    );
+    // visuals copies images and instances by these
+    for (auto &image : images)
+        if (uint64_t(image.begin) + image.size > header.sizes[4])
+            return false;
+    for (auto &primitive : primitives)
+        if (
+            uint64_t(primitive.instance_begin) + primitive.instance_count >
+            instances.size()
+        )
+            return false;
+    // and draws the indices of each primitive, which point to its vertices
+    uint64_t vertex_count = std::min({
+        header.sizes[0] / 8, header.sizes[1] / 4, header.sizes[2] / 4
+    });
+    auto indices = cache.data + header.offsets[3];
+    for (auto &primitive : primitives) {
+        uint64_t face_end = uint64_t(primitive.face_begin) + primitive.face_size;
+        if (
+            face_end > header.sizes[3] / 2 ||
+            primitive.vertex_begin > vertex_count
+        )
+            return false;
+        for (auto i = uint64_t(primitive.face_begin); i < face_end; i++) {
+            uint16_t index;
+            std::memcpy(&index, indices + i * 2, 2);
+            if (index >= vertex_count - primitive.vertex_begin)
+                return false;
+        }
+    }
+
+    m.primitives = std::move(primitives);
+    m.images = std::move(images);
+    m.instances = std::move(instances);
+    for (auto i = 0u; i < header.offsets.size(); i++)
+        *m.arrays()[i] = {cache.data + header.offsets[i], header.sizes[i]};
+    m.storage = {};
+    m.cache = std::move(cache);
+    return true;
+}
+
+// Written under another name first, so that a file that is cut short never
+// has the final name. Failing isn't an error, the next run converts again.
+void write_cache(
+    model &m, const std::string &name, uint64_t source_hash,
+    uint64_t source_size
+) {
+    cache_header header;
+    header.source_hash = source_hash;
+    header.source_size = source_size;
+    header.primitive_count = m.primitives.size();
+    header.image_count = m.images.size();
+    header.instance_count = m.instances.size();
+    uint64_t offset = sizeof(header) +
+        m.primitives.size() * sizeof(model::mesh_primitive) +
+        m.images.size() * sizeof(model::image) +
+        m.instances.size() * sizeof(glm::mat4);
+    for (auto i = 0u; i < header.offsets.size(); i++) {
+        offset = align_array(offset);
+        header.offsets[i] = offset;
+        header.sizes[i] = m.arrays()[i]->size();
+        offset += header.sizes[i];
+    }
+
+    auto temporary = name + ".part";
+    bool written;
+    {
+        std::unique_ptr<FILE, file_deleter> file(
+            fopen(temporary.c_str(), "wb")
         );
-        images.push_back({
-            static_cast<uint32_t>(pixels.size()),
-            static_cast<uint32_t>(image.size()),
-            width, height
-        });
-        pixels.insert(pixels.end(), image.begin(), image.end());
+        if (!file)
+            return;
+        written =
+            fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+            fwrite(
+                m.primitives.data(), sizeof(model::mesh_primitive),
+                m.primitives.size(), file.get()
+            ) == m.primitives.size() &&
+            fwrite(
+                m.images.data(), sizeof(model::image), m.images.size(),
+                file.get()
+            ) == m.images.size() &&
+            fwrite(
+                m.instances.data(), sizeof(glm::mat4), m.instances.size(),
+                file.get()
+            ) == m.instances.size();
+        for (auto i = 0u; written && i < header.offsets.size(); i++) {
+            auto array = *m.arrays()[i];
+            written =
+                fseek(file.get(), header.offsets[i], SEEK_SET) == 0 &&
+                fwrite(array.data(), 1, array.size(), file.get()) ==
+                    array.size();
+        }
+        written = fflush(file.get()) == 0 && written;
+    }
+    // rename doesn't replace files everywhere
+    std::remove(name.c_str());
+    if (!written || std::rename(temporary.c_str(), name.c_str()) != 0)
+        std::remove(temporary.c_str());
+}
+
+model load_model(const char *name) {
+    auto cache_name = std::string(name) + model_cache_extension;
+    mapped_file source(name);
+    auto source_hash = content_hash(source.content());
+    auto source_size = source.size;
+
+    model m;
+    try {
+        mapped_file cache(cache_name.c_str());
+        if (read_cache(m, std::move(cache), source_hash, source_size))
+            return m;
+    } catch (const std::runtime_error &) {
+        // there is no cache file yet
     }
+
+    m = model(source.content());
+    // not needed anymore while the cache is written
+    source.release();
+#ifndef __EMSCRIPTEN__
+    write_cache(m, cache_name, source_hash, source_size);
+#endif
+    return m;
 }
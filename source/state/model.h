@@ -1,23 +1,37 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <ranges>
+#include <span>
 #include <vector>
 
 #include <glm/glm.hpp>
 
+#include "../utility/file.h"
+
 /**
  * @brief The model class stores a gltf file with all vertex data converted to
  * standard structure.
  * TOOD: allow partial and streamed parsing and conversion.
  */
 struct model {
-    struct node_primitive {
-        // represents a pair of a node and a primitive in gltf
+    struct mesh_primitive {
+        // Represents a primitive of a gltf mesh, or a part of it, so that its
+        // indices fit into 16 bit. It's stored once and drawn for each node
+        // that uses it.
         uint32_t vertex_begin;
         uint32_t face_begin, face_size;
         uint32_t image_index;
-        glm::mat4 world_matrix = glm::mat4(1.0);
+        // the world matrices of those nodes in instances
+        uint32_t instance_begin, instance_count;
+        // Positions go from -1 to 1 in the primitive's bounds, around
+        // position_offset by position_scale. Texture coordinates go from 0 to
+        // 1.
+        glm::vec3 position_offset = glm::vec3(0), position_scale = glm::vec3(1);
+        glm::vec2
+            texture_coordinate_offset = glm::vec2(0),
+            texture_coordinate_scale = glm::vec2(1);
     };
 
     struct image {
@@ -28,30 +42,66 @@ struct model {
     model() = default;
     model(std::ranges::subrange<uint8_t*> file);
 
-    // TODO Standard mesh format:
-    // (right now all data is stored in gltf's format)
-    // short positions.xyz*, short normals.xyz*, short texture_coordinates.uv*,
-    // short joints.xyzw*, byte weights.xyzw*
-    // short indices*
-    // Indices are 16 bit. Meshes with more vertices than fit into that, are
+    // Standard mesh format, per vertex:
+    // positions: 16 bit signed normalized xyz and 16 bit padding
+    // normals: 10 bit unsigned normalized xyz from -1 to 1 and 2 bit padding,
+    // in the layout of A2B10G10R10
+    // texture_coordinates: 16 bit unsigned normalized uv
+    // Indices are 16 bit. Meshes with more vertices than fit into that are
     // split up.
+    // TODO: short joints.xyzw*, byte weights.xyzw*
 
     unsigned
         primitive_count, vertex_count, primitive_offset,
         position_offset, normal_offset, texture_coordinate_offset;
 
-    std::vector<uint8_t> positions;
-    std::vector<uint8_t> normals;
-    std::vector<uint8_t> texture_coordinates;
-    std::vector<uint8_t> indices;
-    std::vector<uint8_t> pixels;
-    std::vector<node_primitive> primitives;
+    // Lays out arrays of these sizes in storage, in the order of arrays()
+    void allocate(std::array<size_t, 5> sizes);
+    std::array<std::span<uint8_t>*, 5> arrays();
+
+    // In storage, or in cache when the model was loaded from a cache file.
+    // Each one starts at a multiple of model_array_alignment from the start of
+    // either.
+    std::span<uint8_t> positions;
+    std::span<uint8_t> normals;
+    std::span<uint8_t> texture_coordinates;
+    std::span<uint8_t> indices;
+    std::span<uint8_t> pixels;
+    std::vector<mesh_primitive> primitives;
     std::vector<image> images;
+    // world matrices, those of each primitive next to each other
+    std::vector<glm::mat4> instances;
+
+    std::vector<uint8_t> storage;
+    mapped_file cache;
 };
 
+const size_t model_array_alignment = 64;
+
+// the file name that load_model appends to the source's for its cache file
+extern const char *model_cache_extension;
+
+// Loads a glTF file through a converted copy in a cache file next to it. That
+// is written on the first run, and mapped as is as long as the content hash of
+// the source matches, so that later runs don't convert anything. Natively the
+// source is still read once for the hash. Emscripten can't keep files, there
+// only cache files that were made beforehand and preloaded are used.
+model load_model(const char *name);
+
+// Threads that decode images and convert vertices while loading a model, the
+// loading one included. 0 uses every hardware thread.
+extern unsigned model_thread_count;
+
 void parse_check(bool correct);
 
-std::vector<uint8_t> read_png(
-    std::ranges::subrange<uint8_t*> file,
-    unsigned &width, unsigned &height
+// Width and height from the header, false if file doesn't start like a PNG
+bool read_png_size(
+    std::ranges::subrange<uint8_t*> file, unsigned &width, unsigned &height
+);
+
+// Decodes to 8 bit RGBA into pixels, which has room for the width and height
+// from the header. Throws if the image turns out to have another size.
+void read_png(
+    std::ranges::subrange<uint8_t*> file, std::span<uint8_t> pixels,
+    unsigned width, unsigned height
 );
@@ -0,0 +1,98 @@
+#include "pose_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the server's
+std::chrono::duration<double> playout_tick_time{0.05};
+// Ticks behind the expected arrival that are always added, one so that the
+// next snapshot is usually there to interpolate towards
+double minimum_playout_delay = 1;
+// how many times the jitter is added to the delay
+double jitter_playout_scale = 3;
+double maximum_playout_delay = 10;
+// weight of each new sample in the smoothed offset and jitter, like RFC 3550
+double clock_smoothing = 1.0 / 16;
+// arrivals that are this far off start over, e.g. after the server restarted
+std::chrono::duration<double> clock_reset_threshold{1};
+// after the newest snapshot, poses move on for this many ticks, then stop
+double maximum_extrapolation = 4;
+
+double seconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double>(time.time_since_epoch()).count();
+}
+
+void playout_clock::receive(
+    std::uint32_t tick, std::chrono::steady_clock::time_point arrival
+) {
+    auto tick_time = playout_tick_time.count();
+    auto sample = seconds(arrival) - tick * tick_time;
+    if (
+        !started || tick <= last_tick ||
+        std::abs(sample - offset) > clock_reset_threshold.count()
+    ) {
+        started = true;
+        offset = sample;
+        jitter = 0;
+    } else {
+        std::chrono::duration<double> interval = arrival - last_arrival;
+        auto deviation =
+            std::abs(interval.count() - (tick - last_tick) * tick_time);
+        jitter += (deviation - jitter) * clock_smoothing;
+        offset += (sample - offset) * clock_smoothing;
+    }
+    last_tick = tick;
+    last_arrival = arrival;
+    delay = std::min(
+        minimum_playout_delay + jitter_playout_scale * jitter / tick_time,
+        maximum_playout_delay
+    );
+}
+
+double playout_clock::tick(std::chrono::steady_clock::time_point time) const {
+    return (seconds(time) - offset) / playout_tick_time.count() - delay;
+}
+
+void pose_buffer::push(
+    std::uint32_t tick, glm::vec3 position, glm::quat orientation
+) {
+    if (size > 0 && tick <= snapshots[size - 1].tick)
+        return;
+    if (size == snapshots.size()) {
+        std::move(snapshots.begin() + 1, snapshots.end(), snapshots.begin());
+        size--;
+    }
+    snapshots[size++] = {tick, position, orientation};
+}
+
+bool pose_buffer::sample(
+    double tick, glm::vec3 &position, glm::quat &orientation
+) const {
+    if (size == 0)
+        return false;
+    auto &newest = snapshots[size - 1];
+    if (size == 1 || tick <= snapshots[0].tick) {
+        auto &only = tick <= snapshots[0].tick ? snapshots[0] : newest;
+        position = only.position;
+        orientation = only.orientation;
+        return true;
+    }
+
+    // the snapshots before and after tick, or the newest two to extrapolate
+    unsigned after = 1;
+    while (after < size - 1 && snapshots[after].tick < tick)
+        after++;
+    auto &a = snapshots[after - 1], &b = snapshots[after];
+    double span = b.tick - a.tick;
+    double limit = 1 + maximum_extrapolation / span;
+    auto t = float(std::min((tick - a.tick) / span, limit));
+
+    position = glm::mix(a.position, b.position, t);
+    // slerp takes the shorter way and extrapolates beyond 1 too
+    orientation = glm::normalize(glm::slerp(a.orientation, b.orientation, t));
+    return true;
+}
+
+void pose_buffer::clear() {
+    size = 0;
+}
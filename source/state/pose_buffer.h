@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// How far behind the server the received poses are shown. Ticks arrive every
+// tick_time, but not evenly. Showing them a little later than they arrive
+// leaves time for late ones, by a delay that grows with the measured jitter.
+struct playout_clock {
+    void receive(
+        std::uint32_t tick, std::chrono::steady_clock::time_point arrival
+    );
+    // the fractional tick to show at time, not before the first receive
+    double tick(std::chrono::steady_clock::time_point time) const;
+
+    bool started = false;
+    std::uint32_t last_tick = 0;
+    std::chrono::steady_clock::time_point last_arrival;
+    // when tick 0 would have arrived, in seconds of the steady clock, smoothed
+    double offset = 0;
+    // mean deviation of the time between two ticks from the tick time, in
+    // seconds
+    double jitter = 0;
+    // behind the time the current tick is expected to arrive, in ticks
+    double delay = 0;
+};
+
+/**
+ * @brief The last few poses of a remote user by tick, to show its pose at
+ * any tick in between by interpolating. Shortly after the newest one, the pose
+ * is extrapolated.
+ */
+struct pose_buffer {
+    struct snapshot {
+        std::uint32_t tick;
+        glm::vec3 position;
+        glm::quat orientation;
+    };
+
+    // ticks that are older than the newest one are ignored
+    void push(
+        std::uint32_t tick, glm::vec3 position, glm::quat orientation
+    );
+    // false if nothing was pushed yet
+    bool sample(
+        double tick, glm::vec3 &position, glm::quat &orientation
+    ) const;
+    void clear();
+
+    // oldest first, the newest at size - 1
+    std::array<snapshot, 8> snapshots;
+    unsigned size = 0;
+};
@@ -0,0 +1,31 @@
+#include "voice_queue.h"
+
+#include <algorithm>
+
+void voice_queue::push(std::span<const std::uint8_t> packet) {
+    if (size == packets.size()) {
+        pop();
+        dropped_count++;
+    }
+    auto &back = packets[(begin + size) % packets.size()];
+    if (back.bytes.size() < packet.size())
+        back.bytes.resize(packet.size());
+    std::copy(packet.begin(), packet.end(), back.bytes.begin());
+    back.size = packet.size();
+    size++;
+}
+
+std::span<const std::uint8_t> voice_queue::front() const {
+    auto &packet = packets[begin];
+    return {packet.bytes.data(), packet.size};
+}
+
+void voice_queue::pop() {
+    begin = (begin + 1) % packets.size();
+    size--;
+}
+
+void voice_queue::clear() {
+    begin = 0;
+    size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <vector>
+#include <cinttypes>
+
+/**
+ * @brief The voice packets of a remote user that were received but not played
+ * yet, oldest first. All frames that arrived are read at once, so after a slow
+ * frame several packets can be waiting. When it's full the oldest packet is
+ * dropped, which keeps the delay of the voice bounded.
+ */
+struct voice_queue {
+    // copies the packet
+    void push(std::span<const std::uint8_t> packet);
+    // the oldest packet, only if size > 0
+    std::span<const std::uint8_t> front() const;
+    void pop();
+    void clear();
+
+    struct packet {
+        // only grows, the first size bytes are used
+        std::vector<std::uint8_t> bytes;
+        std::size_t size = 0;
+    };
+    std::array<packet, 4> packets;
+    unsigned begin = 0, size = 0;
+    // packets that were dropped because the queue was full
+    std::uint64_t dropped_count = 0;
+};
@@ -3,6 +3,15 @@
 #include <memory>
 #include <exception>
 #include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) && !defined(__EMSCRIPTEN__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define MAPPED_FILES
+#endif
 
 #include "trace.h"
 
@@ -20,3 +29,64 @@ std::vector<uint8_t> read_file(const char* name) {
     fread(content.data(), sizeof(uint8_t), size, file.get());
     return content;
 }
+
+mapped_file::mapped_file(const char* name) {
+    scope_trace trace;
+#ifdef MAPPED_FILES
+    int descriptor = open(name, O_RDONLY);
+    if (descriptor == -1)
+        throw std::runtime_error("Couldn't open file.");
+    struct stat status;
+    if (fstat(descriptor, &status) == -1) {
+        close(descriptor);
+        throw std::runtime_error("Couldn't open file.");
+    }
+    size = status.st_size;
+    // mmap doesn't take empty ranges
+    void *mapping = size == 0 ? nullptr : mmap(
+        nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0
+    );
+    // the mapping keeps the file open
+    close(descriptor);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Couldn't map file.");
+    data = static_cast<uint8_t*>(mapping);
+#else
+    buffer = read_file(name);
+    data = buffer.data();
+    size = buffer.size();
+#endif
+}
+
+mapped_file::mapped_file(mapped_file &&other) {
+    *this = std::move(other);
+}
+
+mapped_file &mapped_file::operator=(mapped_file &&other) {
+    if (this != &other) {
+        release();
+        buffer = std::move(other.buffer);
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file() {
+    release();
+}
+
+std::ranges::subrange<uint8_t*> mapped_file::content() const {
+    return {data, data + size};
+}
+
+void mapped_file::release() {
+#ifdef MAPPED_FILES
+    if (data)
+        munmap(data, size);
+#else
+    buffer = {};
+#endif
+    data = nullptr;
+    size = 0;
+}
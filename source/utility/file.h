@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdio>
+#include <cstddef>
 #include <vector>
+#include <ranges>
 #include <cinttypes>
 
 struct file_deleter {
@@ -9,3 +11,25 @@ struct file_deleter {
 };
 
 std::vector<uint8_t> read_file(const char* name);
+
+// The content of a file without reading it all up front. Natively it's mapped,
+// pages are read when touched and may be dropped again while clean. Writing to
+// it only changes this copy. On emscripten, files are preloaded into memory
+// already, there it's read like read_file.
+struct mapped_file {
+    mapped_file() = default;
+    explicit mapped_file(const char* name);
+    mapped_file(mapped_file &&other);
+    mapped_file &operator=(mapped_file &&other);
+    ~mapped_file();
+
+    std::ranges::subrange<uint8_t*> content() const;
+    // Gives back the memory, for when the content was converted to something
+    // else. Before that, it's resident next to the result.
+    void release();
+
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    // where the file can't be mapped
+    std::vector<uint8_t> buffer;
+};
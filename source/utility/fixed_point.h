@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// The instruction set that the batch conversions were compiled for. WASM SIMD
+// needs -msimd128, browsers without it can't load the module.
+#if defined(__SSE2__) || defined(_M_X64)
+constexpr const char *fixed_point_kernel = "sse2";
+#elif defined(__ARM_NEON)
+constexpr const char *fixed_point_kernel = "neon";
+#elif defined(__wasm_simd128__)
+constexpr const char *fixed_point_kernel = "wasm-simd128";
+#else
+constexpr const char *fixed_point_kernel = "scalar";
+#endif
+
+// Batch conversion between floats and big-endian 16 bit fixed point, for the
+// positions of messages. scale is 2^mantissa_bits.
+// Values out of range are clamped, NaN becomes 0 and conversion truncates
+// towards zero, like to_fixed_point. The caller checks that the buffer is big
+// enough.
+
+inline void write_int16_fixed_point_scalar(
+    const float *values, std::size_t size, float scale, std::uint8_t *out
+) {
+    for (std::size_t i = 0; i < size; i++) {
+        // converting NaN is undefined
+        auto integral = std::isnan(values[i]) ? std::int16_t(0) : std::int16_t(
+            std::clamp(values[i] * scale, -32768.f, 32767.f)
+        );
+        out[i * 2 + 0] = std::uint8_t(std::uint16_t(integral) >> 8);
+        out[i * 2 + 1] = std::uint8_t(integral);
+    }
+}
+
+inline void read_int16_fixed_point_scalar(
+    const std::uint8_t *in, std::size_t size, float scale, float *values
+) {
+    for (std::size_t i = 0; i < size; i++) {
+        auto integral = std::int16_t(in[i * 2 + 0] << 8 | in[i * 2 + 1]);
+        values[i] = integral / scale;
+    }
+}
+
+// The vectorized versions convert 8 values at a time and leave the rest to the
+// scalar ones. Multiplying by 1 / scale is exact, scale being a power of two.
+
+inline void write_int16_fixed_point(
+    const float *values, std::size_t size, float scale, std::uint8_t *out
+) {
+    std::size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    auto scales = _mm_set1_ps(scale);
+    auto minimum = _mm_set1_ps(-32768.f), maximum = _mm_set1_ps(32767.f);
+    for (; i + 8 <= size; i += 8) {
+        auto a = _mm_loadu_ps(values + i);
+        auto b = _mm_loadu_ps(values + i + 4);
+        // max would turn NaN into the minimum, NEON and WASM give 0
+        a = _mm_and_ps(a, _mm_cmpord_ps(a, a));
+        b = _mm_and_ps(b, _mm_cmpord_ps(b, b));
+        a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(a, scales), minimum), maximum);
+        b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(b, scales), minimum), maximum);
+        auto packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        // SSE2 has no byte shuffle
+        packed = _mm_or_si128(
+            _mm_slli_epi16(packed, 8), _mm_srli_epi16(packed, 8)
+        );
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2), packed);
+    }
+#elif defined(__ARM_NEON)
+    auto minimum = vdupq_n_f32(-32768.f), maximum = vdupq_n_f32(32767.f);
+    for (; i + 8 <= size; i += 8) {
+        auto a = vmulq_n_f32(vld1q_f32(values + i), scale);
+        auto b = vmulq_n_f32(vld1q_f32(values + i + 4), scale);
+        a = vminq_f32(vmaxq_f32(a, minimum), maximum);
+        b = vminq_f32(vmaxq_f32(b, minimum), maximum);
+        auto packed = vcombine_s16(
+            vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))
+        );
+        vst1q_u8(out + i * 2, vrev16q_u8(vreinterpretq_u8_s16(packed)));
+    }
+#elif defined(__wasm_simd128__)
+    auto scales = wasm_f32x4_splat(scale);
+    auto minimum = wasm_f32x4_splat(-32768.f);
+    auto maximum = wasm_f32x4_splat(32767.f);
+    for (; i + 8 <= size; i += 8) {
+        auto a = wasm_f32x4_mul(wasm_v128_load(values + i), scales);
+        auto b = wasm_f32x4_mul(wasm_v128_load(values + i + 4), scales);
+        a = wasm_f32x4_min(wasm_f32x4_max(a, minimum), maximum);
+        b = wasm_f32x4_min(wasm_f32x4_max(b, minimum), maximum);
+        auto packed = wasm_i16x8_narrow_i32x4(
+            wasm_i32x4_trunc_sat_f32x4(a), wasm_i32x4_trunc_sat_f32x4(b)
+        );
+        wasm_v128_store(
+            out + i * 2,
+            wasm_i8x16_shuffle(
+                packed, packed, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12,
+                15, 14
+            )
+        );
+    }
+#endif
+    write_int16_fixed_point_scalar(values + i, size - i, scale, out + i * 2);
+}
+
+inline void read_int16_fixed_point(
+    const std::uint8_t *in, std::size_t size, float scale, float *values
+) {
+    std::size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    auto scales = _mm_set1_ps(1 / scale);
+    for (; i + 8 <= size; i += 8) {
+        auto packed =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2));
+        packed = _mm_or_si128(
+            _mm_slli_epi16(packed, 8), _mm_srli_epi16(packed, 8)
+        );
+        // sign extends by moving each value to the upper half of 32 bits
+        auto low = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+        auto high = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+        _mm_storeu_ps(values + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scales));
+        _mm_storeu_ps(
+            values + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scales)
+        );
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= size; i += 8) {
+        auto packed = vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(in + i * 2)));
+        vst1q_f32(
+            values + i,
+            vmulq_n_f32(
+                vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed))), 1 / scale
+            )
+        );
+        vst1q_f32(
+            values + i + 4,
+            vmulq_n_f32(
+                vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed))), 1 / scale
+            )
+        );
+    }
+#elif defined(__wasm_simd128__)
+    auto scales = wasm_f32x4_splat(1 / scale);
+    for (; i + 8 <= size; i += 8) {
+        auto packed = wasm_v128_load(in + i * 2);
+        packed = wasm_i8x16_shuffle(
+            packed, packed, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+        );
+        wasm_v128_store(
+            values + i,
+            wasm_f32x4_mul(
+                wasm_f32x4_convert_i32x4(wasm_i32x4_extend_low_i16x8(packed)),
+                scales
+            )
+        );
+        wasm_v128_store(
+            values + i + 4,
+            wasm_f32x4_mul(
+                wasm_f32x4_convert_i32x4(wasm_i32x4_extend_high_i16x8(packed)),
+                scales
+            )
+        );
+    }
+#endif
+    read_int16_fixed_point_scalar(in + i * 2, size - i, scale, values + i);
+}
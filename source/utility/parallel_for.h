@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Calls job(i) for every i below count, on thread_count threads including the
+// calling one. Jobs are taken in order as threads become free, so longer ones
+// should come first. If jobs throw, the first exception is rethrown once all
+// threads are done, the remaining jobs are skipped.
+template<class F>
+void parallel_for(unsigned count, unsigned thread_count, F &&job) {
+    std::atomic_uint next = 0;
+    std::atomic_bool failed = false;
+    std::exception_ptr exception;
+    std::mutex exception_mutex;
+    auto work = [&]() {
+        for (auto i = next++; i < count && !failed; i = next++) {
+            try {
+                job(i);
+            } catch (...) {
+                std::scoped_lock lock(exception_mutex);
+                if (!exception)
+                    exception = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    thread_count = std::clamp(thread_count, 1u, std::max(count, 1u));
+    for (auto i = 1u; i < thread_count; i++)
+        threads.emplace_back(work);
+    work();
+    for (auto &thread : threads)
+        thread.join();
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
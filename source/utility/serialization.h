@@ -3,6 +3,11 @@
 #include <span>
 #include <cinttypes>
 #include <stdexcept>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <concepts>
+#include <cmath>
 
 #include "../utility/unique_span.h"
 
@@ -55,16 +60,42 @@ void apply(size_t size, unique_span<T> &b, F f) {
         apply(b.values[i], f);
 }
 
+template<class T>
+void apply(size_t size, unique_span<T> &values, read_tag_t read) {
+    // make room for whatever the other side sent
+    if (size > values.capacity)
+        values.reset(size);
+    for (size_t i = 0; i < size; i++)
+        apply(values.values[i], read);
+}
+
 template<class T>
 void apply(size_t, unique_span<T> &values, capacity_tag_t capacity) {
     for (size_t i = 0; i < values.capacity; i++)
         apply(values.values[i], capacity);
 }
 
+template<std::integral T, unsigned mantissa_bits, std::floating_point F>
+T to_fixed_point(F value) {
+    // out of range conversions are undefined, e.g. 1.0 with 15 mantissa bits,
+    // and so is NaN, which becomes 0
+    if (std::isnan(value))
+        return 0;
+    return T(std::clamp<F>(
+        value * (1ul << mantissa_bits),
+        std::numeric_limits<T>::min(), std::numeric_limits<T>::max()
+    ));
+}
+
+template<std::integral T, unsigned mantissa_bits, std::floating_point F>
+F from_fixed_point(T value) {
+    return F(value) / (1ul << mantissa_bits);
+}
+
 template<std::integral T, unsigned mantissa_bits, std::floating_point F>
 void apply_fixed_point(size_t size, unique_span<F> &span, write_tag_t write) {
     for (size_t i = 0; i < size; i++) {
-        T integral = T(span.values[i] * (1ul << mantissa_bits));
+        T integral = to_fixed_point<T, mantissa_bits>(span.values[i]);
         apply(integral, write);
     }
 }
@@ -74,7 +105,7 @@ void apply_fixed_point(size_t size, unique_span<F> &span, read_tag_t read) {
     for (size_t i = 0; i < size; i++) {
         T integral;
         apply(integral, read);
-        span.values[i] = float(integral) / (1ul << mantissa_bits);
+        span.values[i] = from_fixed_point<T, mantissa_bits, F>(integral);
     }
 }
 
@@ -84,3 +115,54 @@ void apply_fixed_point(
 ) {
     capacity.size += values.capacity * sizeof(T);
 }
+
+// Bit level serialization for fields that are usually unchanged, so they can
+// cost a single bit. Bits are stored most significant first. The last byte is
+// padded with zeros by flush and skipped by align.
+
+struct bit_write_tag_t {
+    std::span<uint8_t> &b;
+    std::uint64_t bits = 0;
+    unsigned bit_count = 0;
+};
+
+struct bit_read_tag_t {
+    std::span<uint8_t> &b;
+    std::uint64_t bits = 0;
+    unsigned bit_count = 0;
+};
+
+template<std::unsigned_integral T>
+void apply_bits(T value, unsigned size, bit_write_tag_t &write) {
+    write.bits = (write.bits << size) | (value & ((1ull << size) - 1));
+    write.bit_count += size;
+    while (write.bit_count >= 8) {
+        if (write.b.empty())
+            throw std::overflow_error("message truncated");
+        write.bit_count -= 8;
+        write.b[0] = uint8_t(write.bits >> write.bit_count);
+        write.b = {write.b.begin() + 1, write.b.size() - 1};
+    }
+}
+
+template<std::unsigned_integral T>
+void apply_bits(T &value, unsigned size, bit_read_tag_t &read) {
+    while (read.bit_count < size) {
+        if (read.b.empty())
+            throw std::overflow_error("message truncated");
+        read.bits = (read.bits << 8) | read.b[0];
+        read.bit_count += 8;
+        read.b = {read.b.begin() + 1, read.b.size() - 1};
+    }
+    read.bit_count -= size;
+    value = T((read.bits >> read.bit_count) & ((1ull << size) - 1));
+}
+
+inline void flush(bit_write_tag_t &write) {
+    if (write.bit_count > 0)
+        apply_bits(0u, 8 - write.bit_count, write);
+}
+
+inline void align(bit_read_tag_t &read) {
+    read.bit_count = 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "unique_span.h"
+
+// Lock-free queue of preallocated slots between one producer thread and one
+// consumer thread. The producer fills back() and publishes it with push(), the
+// consumer reads front() and hands it back with pop(). Slots keep their
+// values, so buffers in them keep their capacity for the next use.
+template<class T>
+struct spsc_ring {
+    spsc_ring() = default;
+
+    // not thread-safe, before either side uses the ring
+    void reset(unsigned capacity) {
+        slots.reset(capacity);
+        head = 0;
+        tail = 0;
+    }
+
+    // producer side, nullptr if the ring is full
+    T *back() {
+        auto tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == slots.size())
+            return nullptr;
+        return &slots[tail % slots.size()];
+    }
+    void push() {
+        tail.store(
+            tail.load(std::memory_order_relaxed) + 1, std::memory_order_release
+        );
+    }
+
+    // consumer side, nullptr if the ring is empty
+    T *front() {
+        auto head = this->head.load(std::memory_order_relaxed);
+        if (head == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[head % slots.size()];
+    }
+    void pop() {
+        head.store(
+            head.load(std::memory_order_relaxed) + 1, std::memory_order_release
+        );
+    }
+
+    unique_span<T> slots;
+    // Count up forever, so that full and empty can be told apart. Each is
+    // only written by one side, on its own cache line.
+    alignas(64) std::atomic_size_t head = 0;
+    alignas(64) std::atomic_size_t tail = 0;
+};
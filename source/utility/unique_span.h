@@ -18,6 +18,7 @@ struct unique_span {
     unique_span(const unique_span &other) : capacity(other.capacity) {
         copy(other, std::views::all(*this));
     }
+    unique_span(unique_span &&other) = default;
     void reset(unsigned capacity) {
         this->capacity = capacity;
         values = std::make_unique<T[]>(capacity);
@@ -44,6 +45,7 @@ struct unique_span {
         copy(other, std::views::all(*this));
         return *this;
     }
+    unique_span<T> &operator=(unique_span<T> &&other) = default;
 
 
     std::unique_ptr<T[]> values;
@@ -4,19 +4,30 @@
 layout (std140, binding = 0) uniform parameters {
     mat4 model_view_projection_matrix;
     mat4 model_matrix;
+    vec4 texture_coordinate_transform;
+    vec4 position_offset, position_scale;
 };
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+// quantized, see model.h
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec4 normal;
 layout (location = 2) in vec2 texture_coordinate;
+// per instance, the world matrix of a node
+layout (location = 3) in mat4 instance_matrix;
 
 layout(location = 0) out vec2 fragment_texture_coordinate;
 layout(location = 1) out vec3 fragment_normal;
 
 void main() {
+    vec3 model_position =
+        position_offset.xyz + position_scale.xyz * position.xyz;
     gl_Position = (
-        model_view_projection_matrix * vec4(position, 1.0)
+        model_view_projection_matrix * instance_matrix *
+        vec4(model_position, 1.0)
     );
-    fragment_texture_coordinate = texture_coordinate;
-    fragment_normal = mat3(model_matrix) * normal;
+    fragment_texture_coordinate =
+        texture_coordinate_transform.xy +
+        texture_coordinate_transform.zw * texture_coordinate;
+    fragment_normal =
+        mat3(model_matrix) * mat3(instance_matrix) * (normal.xyz * 2.0 - 1.0);
 }
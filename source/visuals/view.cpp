@@ -54,6 +54,8 @@ void record_command_buffer(
         primitive++;
     }
     for (auto i = 0u; i < client.users.position.size(); i++) {
+        if (!client.users.present[i])
+            continue;
         for (auto j = 0u; j < client.test_model.primitives.size(); j++) {
             if (primitive >= view.descriptor_set_count)
                 break;
@@ -153,6 +155,29 @@ void record_command_buffer(
         pipeline_layout, 0, 1, descriptor_sets, 0, nullptr
     );
 
+    // Instances are bound at an offset and drawn from instance 0, because
+    // WebGL has no base instance
+    auto draw = [&](
+        const ::visuals::visual_model &model,
+        const ::model::mesh_primitive &mesh_primitive
+    ) {
+        VkBuffer instance_buffer = visuals.vertex_buffer.get();
+        VkDeviceSize instance_offset =
+            model.instances_offset +
+            VkDeviceSize(mesh_primitive.instance_begin) * sizeof(glm::mat4);
+        vkCmdBindVertexBuffers(
+            image.draw_command_buffer, 3, 1, &instance_buffer, &instance_offset
+        );
+        vkCmdDrawIndexed(
+            image.draw_command_buffer,
+            mesh_primitive.face_size,
+            mesh_primitive.instance_count,
+            mesh_primitive.face_begin,
+            mesh_primitive.vertex_begin,
+            0
+        );
+    };
+
     primitive = 0u;
 
     // draw world
@@ -170,7 +195,7 @@ void record_command_buffer(
         );
         vkCmdBindIndexBuffer(
             image.draw_command_buffer, visuals.index_buffer.get(),
-            model.indices_offset, VK_INDEX_TYPE_UINT32
+            model.indices_offset, VK_INDEX_TYPE_UINT16
         );
     }
 
@@ -185,14 +210,7 @@ void record_command_buffer(
             pipeline_layout, 0, 1, descriptor_sets, 0, nullptr
         );
 
-        vkCmdDrawIndexed(
-            image.draw_command_buffer,
-            client.world_model.primitives[j].face_size,
-            1,
-            client.world_model.primitives[j].face_begin,
-            client.world_model.primitives[j].vertex_begin,
-            0
-        );
+        draw(visuals.models[1], client.world_model.primitives[j]);
 
         primitive++;
     }
@@ -212,11 +230,13 @@ void record_command_buffer(
         );
         vkCmdBindIndexBuffer(
             image.draw_command_buffer, visuals.index_buffer.get(),
-            model.indices_offset, VK_INDEX_TYPE_UINT32
+            model.indices_offset, VK_INDEX_TYPE_UINT16
         );
     }
 
     for (auto i = 0u; i < client.users.position.size(); i++) {
+        if (!client.users.present[i])
+            continue;
         for (auto j = 0u; j < client.test_model.primitives.size(); j++) {
             if (primitive >= view.descriptor_set_count)
                 break;
@@ -228,14 +248,7 @@ void record_command_buffer(
                 pipeline_layout, 0, 1, descriptor_sets, 0, nullptr
             );
 
-            vkCmdDrawIndexed(
-                image.draw_command_buffer,
-                client.test_model.primitives[j].face_size,
-                1,
-                client.test_model.primitives[j].face_begin,
-                client.test_model.primitives[j].vertex_begin,
-                0
-            );
+            draw(visuals.models[0], client.test_model.primitives[j]);
 
             primitive++;
         }
@@ -475,39 +488,71 @@ view::view(client& c, visuals &v, VkInstance instance, VkSurfaceKHR surface) {
         VkVertexInputBindingDescription vertex_input_binding_description[]{
             {
                 .binding = 0,
-                .stride = 4 * 3,
+                .stride = 2 * 4,
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
             },
             {
                 .binding = 1,
-                .stride = 4 * 3,
+                .stride = 4,
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
             },
             {
                 .binding = 2,
-                .stride = 4 * 2,
+                .stride = 2 * 2,
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
             },
+            {
+                .binding = 3,
+                .stride = sizeof(glm::mat4),
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+            },
         };
+        // In model's format. Vertex buffers have to support these formats.
+        // Normals are unsigned, because the signed packed format is optional.
         VkVertexInputAttributeDescription vertex_input_attribute_description[]{
             VkVertexInputAttributeDescription{
                 .location = 0,
                 .binding = 0,
-                .format = VK_FORMAT_R32G32B32_SFLOAT,
+                .format = VK_FORMAT_R16G16B16A16_SNORM,
                 .offset = 0,
             },
             VkVertexInputAttributeDescription{
                 .location = 1,
                 .binding = 1,
-                .format = VK_FORMAT_R32G32B32_SFLOAT,
+                .format = VK_FORMAT_A2B10G10R10_UNORM_PACK32,
                 .offset = 0,
             },
             VkVertexInputAttributeDescription{
                 .location = 2,
                 .binding = 2,
-                .format = VK_FORMAT_R32G32_SFLOAT,
+                .format = VK_FORMAT_R16G16_UNORM,
                 .offset = 0,
             },
+            // the instance's world matrix, a column at each location
+            VkVertexInputAttributeDescription{
+                .location = 3,
+                .binding = 3,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 0,
+            },
+            VkVertexInputAttributeDescription{
+                .location = 4,
+                .binding = 3,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = sizeof(glm::vec4),
+            },
+            VkVertexInputAttributeDescription{
+                .location = 5,
+                .binding = 3,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 2 * sizeof(glm::vec4),
+            },
+            VkVertexInputAttributeDescription{
+                .location = 6,
+                .binding = 3,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 3 * sizeof(glm::vec4),
+            },
         };
         VkPipelineVertexInputStateCreateInfo input_state_create_info{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -987,16 +1032,31 @@ VkResult view::draw(visuals &v, ::client& client) {
             projection * view;
 
         auto primitive = 0u;
+        auto set = [&](
+            const model::mesh_primitive &mesh_primitive, glm::mat4 model
+        ) {
+            auto &parameter = parameters->parameters[primitive];
+            parameter.model_view_projection_matrix = projection * view * model;
+            parameter.model_matrix = model;
+            parameter.texture_coordinate_transform = glm::vec4(
+                mesh_primitive.texture_coordinate_offset,
+                mesh_primitive.texture_coordinate_scale
+            );
+            parameter.position_offset =
+                glm::vec4(mesh_primitive.position_offset, 0);
+            parameter.position_scale =
+                glm::vec4(mesh_primitive.position_scale, 0);
+            primitive++;
+        };
         for (auto j = 0u; j < client.world_model.primitives.size(); j++) {
             if (primitive >= std::size(parameters->parameters))
                 break;
             auto model = glm::mat4(glm::mat3(-1, 0, 0, 0, 0, 1, 0, 1, 0));
-            parameters->parameters[primitive].model_view_projection_matrix =
-                projection * view * model;
-            parameters->parameters[primitive].model_matrix = model;
-            primitive++;
+            set(client.world_model.primitives[j], model);
         }
         for (auto i = 0u; i < client.users.position.size(); i++) {
+            if (!client.users.present[i])
+                continue;
             for (auto j = 0u; j < client.test_model.primitives.size(); j++) {
                 if (primitive >= std::size(parameters->parameters))
                     break;
@@ -1010,10 +1070,7 @@ VkResult view::draw(visuals &v, ::client& client) {
                         glm::mat4(1.0),
                         glm::vec3(0, -1.37, 0.08)
                     );
-                parameters->parameters[primitive].model_view_projection_matrix =
-                    projection * view * model;
-                parameters->parameters[primitive].model_matrix = model;
-                primitive++;
+                set(client.test_model.primitives[j], model);
             }
         }
 
@@ -367,7 +367,8 @@ visuals::visuals(::client& client, VkInstance instance, VkSurfaceKHR surface) {
         *pixels = pixel_mapping->bytes;
     uint8_t *vertex = vertices, *index = indices, *pixel = pixels;
 
-    for (auto &model : {client.test_model, client.world_model}) {
+    for (auto model_pointer : {&client.test_model, &client.world_model}) {
+        auto &model = *model_pointer;
         models.push_back({});
         auto& visual_model = models.back();
 
@@ -377,6 +378,12 @@ visuals::visuals(::client& client, VkInstance instance, VkSurfaceKHR surface) {
         vertex = std::ranges::copy(model.normals, vertex).out;
         visual_model.texture_coordinate_offset = vertex - vertices;
         vertex = std::ranges::copy(model.texture_coordinates, vertex).out;
+        visual_model.instances_offset = vertex - vertices;
+        std::memcpy(
+            vertex, model.instances.data(),
+            model.instances.size() * sizeof(glm::mat4)
+        );
+        vertex += model.instances.size() * sizeof(glm::mat4);
 
         visual_model.indices_offset = index - indices;
         index = std::ranges::copy(model.indices, index).out;
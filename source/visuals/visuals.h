@@ -14,27 +14,23 @@
 
 #include "view.h"
 
-struct a2b10g10r10 {
-    std::uint32_t a : 2, b : 10, g : 10, r : 10;
-};
-
 // use array of struct because binding a single buffer range per draw is cheap
 // all Vulkan and GL implementations support aligning at 256
 // TODO: use minUniformBufferOffsetAlignment
 struct alignas(256) parameter {
+    // applied after the instance's world matrix
     glm::mat4 model_view_projection_matrix;
     glm::mat4 model_matrix;
+    // offset in xy and scale in zw, from quantized texture coordinates
+    glm::vec4 texture_coordinate_transform;
+    // in xyz, from quantized positions
+    glm::vec4 position_offset, position_scale;
 };
 
 struct parameters {
     parameter parameters[256];
 };
 
-struct meshes {
-    a2b10g10r10 vertices_position[1024];
-    std::uint16_t faces_vertices[1024];
-};
-
 struct visuals {
     visuals(::client& client, VkInstance instance, VkSurfaceKHR surface);
 
@@ -85,7 +81,7 @@ struct visuals {
         uint32_t
             position_offset, normal_offset,
             texture_coordinate_offset, indices_offset,
-            images_offset;
+            images_offset, instances_offset;
     };
     std::vector<visual_model> models;
 